@@ -0,0 +1,91 @@
+#ifndef _BENCH_TIMER_H
+#define _BENCH_TIMER_H
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#if defined(_WIN32)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define BENCH_HAS_CYCLE_COUNTER
+#endif /* defined(_M_X64) */
+
+/*-- wall-clock and cycle timing --*/
+
+struct BenchSample {
+  double seconds;
+  uint64_t cycles;
+};
+
+/**
+ * Read the time-stamp counter. This counts reference cycles, so turbo and
+ * frequency scaling make cycles/byte an approximation; it is still the
+ * most comparable number across runs on the same host.
+ *
+ * @return cycle count, or 0 if the architecture has no usable counter
+ */
+inline uint64_t BenchReadCycles() {
+#ifdef BENCH_HAS_CYCLE_COUNTER
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+class BenchTimer {
+ public:
+  void Start() {
+    this->start_time_ = std::chrono::steady_clock::now();
+    this->start_cycles_ = BenchReadCycles();
+  }
+
+  BenchSample Stop() const {
+    uint64_t cycles = BenchReadCycles() - this->start_cycles_;
+    auto elapsed = std::chrono::steady_clock::now() - this->start_time_;
+    return BenchSample{std::chrono::duration<double>(elapsed).count(), cycles};
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_time_;
+  uint64_t start_cycles_ = 0;
+};
+
+/**
+ * Run a workload repeatedly and keep the fastest iteration
+ *
+ * @param min_seconds minimum total time to spend measuring
+ * @param min_iterations minimum number of iterations
+ * @param iterations receives the number of iterations that were run
+ * @param body workload; returns false to abort the measurement
+ *
+ * @return fastest sample, or a zero sample if the workload failed
+ */
+template <class Body>
+BenchSample BenchMeasure(double min_seconds, int min_iterations,
+                         int* iterations, Body body) {
+  auto best = BenchSample{0, 0};
+  double total = 0;
+  int count = 0;
+
+  while (count < min_iterations || total < min_seconds) {
+    BenchTimer timer;
+    timer.Start();
+    if (!body()) {
+      *iterations = count;
+      return BenchSample{0, 0};
+    }
+    auto sample = timer.Stop();
+
+    if (!count || sample.seconds < best.seconds) best = sample;
+    total += sample.seconds;
+    count++;
+  }
+
+  *iterations = count;
+  return best;
+}
+
+#endif /* !_BENCH_TIMER_H */
@@ -0,0 +1,269 @@
+#ifndef _CORPUS_H
+#define _CORPUS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "framing.h"
+
+/*-- deterministic benchmark corpora --*/
+
+struct Corpus {
+  std::string name;
+  /* uncompressed messages; most corpora hold a single message */
+  std::vector<std::vector<unsigned char>> messages;
+};
+
+struct CompressedCorpus {
+  std::string name;
+  Framing framing;
+  std::vector<std::vector<unsigned char>> original;
+  std::vector<std::vector<unsigned char>> compressed;
+  size_t original_size;
+  size_t compressed_size;
+  size_t max_message_size;
+};
+
+/** splitmix64, so that every run on every host generates the same bytes */
+class CorpusRandom {
+ public:
+  explicit CorpusRandom(uint64_t seed) : state_(seed) {}
+
+  uint64_t Next() {
+    uint64_t z = (this->state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  unsigned int Below(unsigned int n) {
+    return (unsigned int)(this->Next() % n);
+  }
+
+  /** Roughly Zipf-distributed index in [0, n) */
+  unsigned int Skewed(unsigned int n) {
+    unsigned int a = this->Below(n);
+    unsigned int b = this->Below(a + 1);
+    return this->Below(b + 1);
+  }
+
+ private:
+  uint64_t state_;
+};
+
+const char* const kCorpusWords[] = {
+    "the",      "of",       "and",      "to",        "in",       "a",
+    "is",       "that",     "for",      "it",        "as",       "was",
+    "with",     "be",       "by",       "on",        "not",      "he",
+    "this",     "are",      "or",       "his",       "from",     "at",
+    "which",    "but",      "have",     "an",        "had",      "they",
+    "you",      "were",     "their",    "one",       "all",      "we",
+    "can",      "her",      "has",      "there",     "been",     "if",
+    "more",     "when",     "will",     "would",     "who",      "so",
+    "no",       "decoder",  "stream",   "buffer",    "window",   "symbol",
+    "length",   "distance", "literal",  "table",     "header",   "block",
+    "compress", "inflate",  "format",   "checksum",  "library",  "memory",
+    "player",   "video",    "audio",    "texture",   "surface",  "thread",
+    "package",  "license",  "software", "copyright", "permission",
+    "notice",   "warranty", "holder",   "contributors"};
+
+const char* const kCorpusLicenses[] = {
+    "Permission is hereby granted, free of charge, to any person obtaining a "
+    "copy\nof this software and associated documentation files (the "
+    "\"Software\"), to deal\nin the Software without restriction, including "
+    "without limitation the rights\nto use, copy, modify, merge, publish, "
+    "distribute, sublicense, and/or sell\ncopies of the Software, and to "
+    "permit persons to whom the Software is\nfurnished to do so, subject to "
+    "the following conditions:\n\nThe above copyright notice and this "
+    "permission notice shall be included in all\ncopies or substantial "
+    "portions of the Software.\n",
+    "Redistribution and use in source and binary forms, with or without\n"
+    "modification, are permitted provided that the following conditions "
+    "are\nmet:\n\n    * Redistributions of source code must retain the above "
+    "copyright\nnotice, this list of conditions and the following "
+    "disclaimer.\n    * Redistributions in binary form must reproduce the "
+    "above\ncopyright notice, this list of conditions and the following\n"
+    "disclaimer in the documentation and/or other materials provided\nwith "
+    "the distribution.\n",
+    "Licensed under the Apache License, Version 2.0 (the \"License\");\nyou "
+    "may not use this file except in compliance with the License.\nYou may "
+    "obtain a copy of the License at\n\n    "
+    "http://www.apache.org/licenses/LICENSE-2.0\n\nUnless required by "
+    "applicable law or agreed to in writing, software\ndistributed under "
+    "the License is distributed on an \"AS IS\" BASIS,\nWITHOUT WARRANTIES "
+    "OR CONDITIONS OF ANY KIND, either express or implied.\n",
+};
+
+void CorpusAppend(std::vector<unsigned char>* out, const std::string& s) {
+  out->insert(out->end(), s.begin(), s.end());
+}
+
+std::string CorpusSentence(CorpusRandom* random) {
+  auto sentence = std::string{};
+  auto words = 4 + random->Below(14);
+  constexpr auto kWords = sizeof(kCorpusWords) / sizeof(kCorpusWords[0]);
+  for (unsigned int i = 0; i < words; i++) {
+    if (i) sentence += ' ';
+    sentence += kCorpusWords[random->Skewed(kWords)];
+  }
+  if (!sentence.empty()) sentence[0] -= 'a' - 'A';
+  sentence += random->Below(8) ? ". " : ".\n";
+  return sentence;
+}
+
+/** Prose-like text with a skewed word distribution */
+Corpus MakeTextCorpus(size_t size) {
+  auto random = CorpusRandom{0x7465787431ULL};
+  auto corpus = Corpus{"text", {{}}};
+  auto& data = corpus.messages[0];
+  while (data.size() < size) CorpusAppend(&data, CorpusSentence(&random));
+  data.resize(size);
+  return corpus;
+}
+
+/** Flutter NOTICES layout: package names, license text, 80-dash separators */
+Corpus MakeNoticesCorpus(size_t size) {
+  auto random = CorpusRandom{0x6e6f7469636573ULL};
+  auto corpus = Corpus{"notices", {{}}};
+  auto& data = corpus.messages[0];
+  auto separator = std::string(80, '-') + "\n";
+  constexpr auto kWords = sizeof(kCorpusWords) / sizeof(kCorpusWords[0]);
+  constexpr auto kLicenses =
+      sizeof(kCorpusLicenses) / sizeof(kCorpusLicenses[0]);
+  while (data.size() < size) {
+    auto packages = 1 + random.Below(4);
+    for (unsigned int i = 0; i < packages; i++) {
+      auto name = std::string{kCorpusWords[random.Below(kWords)]};
+      name += '_';
+      name += kCorpusWords[random.Below(kWords)];
+      CorpusAppend(&data, name + "\n");
+    }
+    auto year = std::to_string(1990 + random.Below(34));
+    CorpusAppend(&data, "\nCopyright " + year + " The " +
+                            kCorpusWords[random.Below(kWords)] +
+                            " Authors. All rights reserved.\n\n");
+    CorpusAppend(&data, kCorpusLicenses[random.Below(kLicenses)]);
+    CorpusAppend(&data, separator);
+  }
+  data.resize(size);
+  return corpus;
+}
+
+/** Structured binary records, similar to object files and asset tables */
+Corpus MakeBinaryCorpus(size_t size) {
+  auto random = CorpusRandom{0x62696e617279ULL};
+  auto corpus = Corpus{"binary", {{}}};
+  auto& data = corpus.messages[0];
+  uint32_t address = 0x400000;
+  while (data.size() < size) {
+    unsigned char record[24];
+    uint32_t opcode = 0x48000000 | (random.Skewed(64) << 16) |
+                      (random.Skewed(256) << 8) | random.Skewed(16);
+    uint32_t length = random.Skewed(4096);
+    float weight = (float)random.Below(1000) / 7.0f;
+    address += 4 * (1 + random.Skewed(32));
+    std::memcpy(record + 0, &opcode, 4);
+    std::memcpy(record + 4, &address, 4);
+    std::memcpy(record + 8, &length, 4);
+    std::memcpy(record + 12, &weight, 4);
+    uint64_t noise = random.Skewed(3) ? 0 : random.Next();
+    std::memcpy(record + 16, &noise, 8);
+    data.insert(data.end(), record, record + sizeof(record));
+  }
+  data.resize(size);
+  return corpus;
+}
+
+/** Long runs of a short pattern with rare mutations (long, close matches) */
+Corpus MakeRepetitiveCorpus(size_t size) {
+  auto random = CorpusRandom{0x726570656174ULL};
+  auto corpus = Corpus{"repetitive", {{}}};
+  auto& data = corpus.messages[0];
+  auto pattern = std::string{"<frame id=\"00\" pts=\"0\"/>\n"};
+  while (data.size() < size) {
+    if (!random.Below(64))
+      pattern[11 + random.Below(2)] = '0' + random.Below(10);
+    CorpusAppend(&data, pattern);
+  }
+  data.resize(size);
+  return corpus;
+}
+
+/** Incompressible bytes; the encoder falls back to stored blocks */
+Corpus MakeRandomCorpus(size_t size) {
+  auto random = CorpusRandom{0x72616e646f6dULL};
+  auto corpus = Corpus{"random", {{}}};
+  auto& data = corpus.messages[0];
+  data.resize(size);
+  for (size_t i = 0; i < size; i += 8) {
+    uint64_t value = random.Next();
+    std::memcpy(data.data() + i, &value, std::min<size_t>(8, size - i));
+  }
+  return corpus;
+}
+
+/** Many small JSON-like messages, each compressed on its own */
+Corpus MakeTinyCorpus(size_t size) {
+  auto random = CorpusRandom{0x74696e79ULL};
+  auto corpus = Corpus{"tiny", {}};
+  constexpr auto kWords = sizeof(kCorpusWords) / sizeof(kCorpusWords[0]);
+  size_t total = 0;
+  while (total < size) {
+    auto message = std::string{"{\"id\":"} +
+                   std::to_string(random.Below(100000)) + ",\"type\":\"" +
+                   kCorpusWords[random.Skewed(kWords)] + "\",\"body\":\"";
+    auto sentences = 1 + random.Below(6);
+    for (unsigned int i = 0; i < sentences; i++)
+      message += CorpusSentence(&random);
+    message += "\"}";
+    total += message.size();
+    corpus.messages.emplace_back(message.begin(), message.end());
+  }
+  return corpus;
+}
+
+std::vector<Corpus> MakeCorpora(size_t size) {
+  auto corpora = std::vector<Corpus>{};
+  corpora.push_back(MakeTextCorpus(size));
+  corpora.push_back(MakeNoticesCorpus(size));
+  corpora.push_back(MakeBinaryCorpus(size));
+  corpora.push_back(MakeRepetitiveCorpus(size));
+  corpora.push_back(MakeRandomCorpus(size));
+  corpora.push_back(MakeTinyCorpus(size / 16));
+  return corpora;
+}
+
+const char* FramingName(Framing framing) {
+  switch (framing) {
+    case Framing::kRaw:
+      return "raw";
+    case Framing::kZlib:
+      return "zlib";
+    case Framing::kGzip:
+      return "gzip";
+  }
+  return "unknown";
+}
+
+CompressedCorpus CompressCorpus(const Corpus& corpus, Framing framing,
+                                int level) {
+  auto result = CompressedCorpus{};
+  result.name = corpus.name;
+  result.framing = framing;
+  result.original = corpus.messages;
+  result.original_size = 0;
+  result.compressed_size = 0;
+  result.max_message_size = 0;
+  for (const auto& message : corpus.messages) {
+    result.compressed.push_back(CompressMessage(message, framing, level));
+    result.original_size += message.size();
+    result.compressed_size += result.compressed.back().size();
+    result.max_message_size = std::max(result.max_message_size, message.size());
+  }
+  return result;
+}
+
+#endif /* !_CORPUS_H */
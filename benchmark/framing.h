@@ -0,0 +1,25 @@
+#ifndef _FRAMING_H
+#define _FRAMING_H
+
+#include <vector>
+
+enum class Framing { kRaw = 0, kZlib = 1, kGzip = 2 };
+
+/**
+ * Deflate a message with the reference zlib encoder. Defined in
+ * zlib_compress.cc, which keeps zlib.h out of this translation unit:
+ * zlib declares its own adler32_z.
+ *
+ * @param data message to compress
+ * @param framing container to wrap the deflate stream in
+ * @param level zlib compression level
+ * @param huffman_only true to deflate with Huffman codes only, without
+ * matches (Z_HUFFMAN_ONLY)
+ *
+ * @return compressed message, or an empty vector in case of an error
+ */
+std::vector<unsigned char> CompressMessage(
+    const std::vector<unsigned char>& data, Framing framing, int level,
+    bool huffman_only = false);
+
+#endif /* !_FRAMING_H */
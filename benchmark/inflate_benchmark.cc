@@ -0,0 +1,1438 @@
+/*-- inflatecpp throughput benchmark --*/
+
+/**
+ * Generates deterministic corpora, wraps them in raw/zlib/gzip framing with
+ * the reference zlib encoder and measures Decompressor::Feed as well as the
+ * individual kernels it is built from. Every corpus is decoded without and
+ * with checksum verification, with FeedTrusted(), with FeedSegments() and
+ * with Verify(), and every mode has to reject each message cut in half,
+ * including when deflated with Huffman codes only. The corpora are also
+ * archived as ZIP bundles of 64 KB entries, to measure ZipReader opening
+ * them, fetching every entry by name and extracting them all in parallel,
+ * and as pax tar.gz archives, to measure TarGzReader indexing them and
+ * extracting their last member from a checkpoint. As BGZF files, BgzfReader
+ * reads them across every block edge and decodes them in parallel.
+ * Compressor and ParallelCompressor are measured against the reference
+ * encoder at the same level, with their output decoded by Feed() to verify
+ * it. Results are written as JSON, so that runs on different commits can be
+ * compared with any JSON-aware tool.
+ *
+ * With --perf, every Feed result also carries Linux hardware counters for
+ * one pass over the corpus. The inflate_benchmark_stats build additionally
+ * splits them by decode phase and reports the INFLATECPP_ENABLE_STATS
+ * counters; its timings include the instrumentation overhead.
+ *
+ * Kernels are dispatched on the features of the host; --cpu-features masks
+ * them (InflateCpuFeature bits, 0 for the baseline kernels) to compare the
+ * variants of the block decoder. Every checksum variant the host supports
+ * is always measured.
+ *
+ * Usage: inflate_benchmark [--size=MiB] [--min-time=seconds] [--level=0..9]
+ *                          [--filter=substring] [--output=file.json] [--perf]
+ *                          [--cpu-features=mask]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "bench_timer.h"
+#include "corpus.h"
+#include "inflatecpp/bgzf_reader.h"
+#include "inflatecpp/chunked_stream.h"
+#include "inflatecpp/compressor.h"
+#include "inflatecpp/decompressor.h"
+#include "inflatecpp/tar_reader.h"
+#include "inflatecpp/zip_reader.h"
+#include "perf_counters.h"
+
+struct BenchOptions {
+  size_t corpus_size = 4 * 1024 * 1024;
+  double min_seconds = 0.25;
+  int min_iterations = 3;
+  int level = 6;
+  std::string filter;
+  std::string output;
+  bool perf = false;
+  unsigned int cpu_features = kCpuAllFeatures;
+};
+
+struct BenchResult {
+  std::string group;
+  std::string name;
+  std::string unit;
+  size_t units;
+  int iterations;
+  BenchSample sample;
+  bool verified;
+  /* extra "key": value pairs, already JSON-encoded */
+  std::vector<std::pair<std::string, std::string>> fields;
+};
+
+bool BenchSelected(const BenchOptions& options, const std::string& name) {
+  return options.filter.empty() ||
+         name.find(options.filter) != std::string::npos;
+}
+
+void BenchPrintResult(FILE* f, const BenchResult& result, bool last) {
+  double seconds = result.sample.seconds;
+  double per_second = seconds > 0 ? (double)result.units / seconds : 0;
+
+  std::fprintf(f, "    {\"group\": \"%s\", \"name\": \"%s\", ",
+               result.group.c_str(), result.name.c_str());
+  for (const auto& field : result.fields)
+    std::fprintf(f, "\"%s\": %s, ", field.first.c_str(), field.second.c_str());
+  std::fprintf(f, "\"unit\": \"%s\", \"units\": %zu, \"iterations\": %d, ",
+               result.unit.c_str(), result.units, result.iterations);
+  std::fprintf(f, "\"seconds\": %.9f, ", seconds);
+  if (result.unit == "bytes")
+    std::fprintf(f, "\"mb_per_s\": %.3f, ", per_second / 1e6);
+  else
+    std::fprintf(f, "\"m%s_per_s\": %.3f, ", result.unit.c_str(),
+                 per_second / 1e6);
+  if (result.sample.cycles && result.units)
+    std::fprintf(f, "\"cycles_per_%s\": %.4f, ",
+                 result.unit == "bytes" ? "byte" : "symbol",
+                 (double)result.sample.cycles / (double)result.units);
+  else
+    std::fprintf(f, "\"cycles_per_%s\": null, ",
+                 result.unit == "bytes" ? "byte" : "symbol");
+  std::fprintf(f, "\"verified\": %s}%s\n", result.verified ? "true" : "false",
+               last ? "" : ",");
+}
+
+/*-- Decompressor::Feed over whole corpora --*/
+
+enum BenchFeedMode {
+  kBenchNoChecksum = 0,
+  kBenchChecksum = 1,
+  kBenchTrusted = 2,
+  kBenchSegments = 3,
+  kBenchVerify = 4,
+};
+
+const char* const kBenchFeedModeNames[] = {"nochecksum", "checksum",
+                                           "trusted", "segments", "verify"};
+
+InflateResult BenchFeedMessage(Decompressor* decompressor,
+                               const std::vector<unsigned char>& compressed,
+                               BenchFeedMode mode,
+                               std::vector<unsigned char>* out) {
+  if (mode == kBenchSegments) {
+    /* reused, so that its allocation is not measured */
+    static auto segments = std::vector<InflateSegment>{};
+    return decompressor->FeedSegments(compressed.data(), compressed.size(),
+                                      out->data(), out->size(), &segments,
+                                      false);
+  }
+  if (mode == kBenchVerify)
+    return decompressor->Verify(compressed.data(), compressed.size());
+  if (mode == kBenchTrusted)
+    return decompressor->FeedTrusted(compressed.data(), compressed.size(),
+                                     out->data(), out->size());
+  return decompressor->Feed(compressed.data(), compressed.size(), out->data(),
+                            out->size(), mode == kBenchChecksum);
+}
+
+bool BenchFeedCorpus(const CompressedCorpus& corpus, BenchFeedMode mode,
+                     std::vector<unsigned char>* out,
+                     Decompressor* decompressor) {
+  for (size_t i = 0; i < corpus.compressed.size(); i++) {
+    auto result =
+        BenchFeedMessage(decompressor, corpus.compressed[i], mode, out);
+    if (!result.Ok() || result.size != corpus.original[i].size()) return false;
+  }
+  return true;
+}
+
+bool BenchVerifySegments(Decompressor* decompressor,
+                         const std::vector<unsigned char>& compressed,
+                         const std::vector<unsigned char>& original,
+                         std::vector<unsigned char>* out) {
+  auto segments = std::vector<InflateSegment>{};
+  auto result =
+      decompressor->FeedSegments(compressed.data(), compressed.size(),
+                                 out->data(), out->size(), &segments, true);
+  if (!result.Ok() || result.size != original.size()) return false;
+
+  size_t offset = 0;
+  for (const auto& segment : segments) {
+    if (offset + segment.size > original.size()) return false;
+    if (std::memcmp(segment.data, original.data() + offset, segment.size))
+      return false;
+    offset += segment.size;
+  }
+  return offset == original.size();
+}
+
+bool BenchVerifyCorpus(const CompressedCorpus& corpus, BenchFeedMode mode,
+                       std::vector<unsigned char>* out) {
+  auto decompressor = Decompressor{};
+  for (size_t i = 0; i < corpus.compressed.size(); i++) {
+    const auto& original = corpus.original[i];
+    if (mode == kBenchSegments) {
+      if (!BenchVerifySegments(&decompressor, corpus.compressed[i], original,
+                               out))
+        return false;
+      continue;
+    }
+
+    auto result =
+        BenchFeedMessage(&decompressor, corpus.compressed[i], mode, out);
+    if (!result.Ok() || result.size != original.size()) return false;
+    /* Verify() has no output to compare */
+    if (mode == kBenchVerify) continue;
+    if (std::memcmp(out->data(), original.data(), original.size()))
+      return false;
+  }
+  return true;
+}
+
+/* shortest compressed message cut in half, which then ends within its
+ * deflate data whatever the framing */
+constexpr size_t kBenchTruncatedMin = 64;
+
+/**
+ * Cut every message of the corpus in half, as deflated for the corpus and
+ * with Huffman codes only: the zeros read past the end of those then decode
+ * as literals, and never end unless the overrun is caught
+ */
+std::vector<std::vector<unsigned char>> BenchTruncateCorpus(
+    const CompressedCorpus& corpus, int level) {
+  auto result = std::vector<std::vector<unsigned char>>{};
+  for (size_t i = 0; i < corpus.compressed.size(); i++) {
+    auto huffman =
+        CompressMessage(corpus.original[i], corpus.framing, level, true);
+    const std::vector<unsigned char>* messages[] = {&corpus.compressed[i],
+                                                    &huffman};
+    for (const auto* compressed : messages) {
+      if (compressed->size() < kBenchTruncatedMin) continue;
+      result.emplace_back(compressed->begin(),
+                          compressed->begin() + compressed->size() / 2);
+    }
+  }
+  return result;
+}
+
+/** Check that every truncated message fails to decode */
+bool BenchVerifyTruncated(
+    const std::vector<std::vector<unsigned char>>& truncated,
+    BenchFeedMode mode, std::vector<unsigned char>* out) {
+  auto decompressor = Decompressor{};
+  for (const auto& compressed : truncated) {
+    if (BenchFeedMessage(&decompressor, compressed, mode, out).Ok())
+      return false;
+  }
+  return true;
+}
+
+#ifdef INFLATECPP_ENABLE_STATS
+/** Accumulates hardware counters per decode phase */
+class BenchPhaseObserver : public InflatePhaseObserver {
+ public:
+  explicit BenchPhaseObserver(const PerfCounters* counters)
+      : counters_(counters) {
+    std::memset(this->totals_, 0, sizeof(this->totals_));
+  }
+
+  void OnPhaseBegin(InflatePhase) override {
+    this->start_ = this->counters_->Read();
+  }
+
+  void OnPhaseEnd(InflatePhase phase) override {
+    PerfAccumulate(&this->totals_[(int)phase],
+                   PerfDelta(this->start_, this->counters_->Read()));
+  }
+
+  const PerfValues& GetTotals(int phase) const { return this->totals_[phase]; }
+
+ private:
+  const PerfCounters* counters_;
+  PerfValues start_;
+  PerfValues totals_[kInflatePhases];
+};
+
+const char* const kBenchPhaseNames[kInflatePhases] = {
+    "header", "table_build", "symbol_loop", "checksum"};
+
+void BenchAccumulateStats(InflateStats* total, const InflateStats& stats) {
+  const auto* from = (const unsigned long long*)&stats;
+  auto* to = (unsigned long long*)total;
+  for (size_t i = 0; i < sizeof(InflateStats) / sizeof(*from); i++)
+    to[i] += from[i];
+}
+
+std::string BenchStatsJson(const InflateStats& stats) {
+  const std::pair<const char*, unsigned long long> fields[] = {
+      {"stored_blocks", stats.stored_blocks},
+      {"fixed_blocks", stats.fixed_blocks},
+      {"dynamic_blocks", stats.dynamic_blocks},
+      {"dynamic_table_ns", stats.dynamic_table_ns},
+      {"table_cache_hits", stats.table_cache_hits},
+      {"table_cache_misses", stats.table_cache_misses},
+      {"fast_symbol_hits", stats.fast_symbol_hits},
+      {"slow_path_symbols", stats.slow_path_symbols},
+      {"slow_path_iterations", stats.slow_path_iterations},
+      {"literals", stats.literals},
+      {"matches", stats.matches},
+      {"match_bytes", stats.match_bytes},
+      {"short_offset_copies", stats.short_offset_copies},
+      {"refills", stats.refills},
+      {"byte_refills", stats.byte_refills},
+      {"stored_bytes", stats.stored_bytes},
+  };
+  auto json = std::string{"{"};
+  for (const auto& field : fields) {
+    if (json.size() > 1) json += ", ";
+    json += std::string{"\""} + field.first + "\": " +
+            std::to_string(field.second);
+  }
+  return json + "}";
+}
+#endif /* INFLATECPP_ENABLE_STATS */
+
+/**
+ * Decode the corpus once more with hardware counters running, and with the
+ * instrumentation counters when they are compiled in
+ */
+void BenchFeedCounters(const CompressedCorpus& corpus, BenchFeedMode mode,
+                       std::vector<unsigned char>* out,
+                       const PerfCounters* counters, BenchResult* result) {
+  auto decompressor = Decompressor{};
+
+#ifdef INFLATECPP_ENABLE_STATS
+  auto observer = BenchPhaseObserver{counters};
+  auto stats = InflateStats{};
+  if (counters) decompressor.SetPhaseObserver(&observer);
+
+  for (size_t i = 0; i < corpus.compressed.size(); i++) {
+    BenchFeedMessage(&decompressor, corpus.compressed[i], mode, out);
+    BenchAccumulateStats(&stats, decompressor.GetStats());
+  }
+  result->fields.emplace_back("stats", BenchStatsJson(stats));
+  decompressor.SetPhaseObserver(nullptr);
+#endif /* INFLATECPP_ENABLE_STATS */
+
+  if (!counters) return;
+
+  auto start = counters->Read();
+  BenchFeedCorpus(corpus, mode, out, &decompressor);
+  auto total = PerfDelta(start, counters->Read());
+  auto json = std::string{"{\"total\": "} + PerfJson(*counters, total);
+
+#ifdef INFLATECPP_ENABLE_STATS
+  json += ", \"phases\": {";
+  for (int phase = 0; phase < kInflatePhases; phase++) {
+    if (phase) json += ", ";
+    json += std::string{"\""} + kBenchPhaseNames[phase] + "\": " +
+            PerfJson(*counters, observer.GetTotals(phase));
+  }
+  json += "}";
+#endif /* INFLATECPP_ENABLE_STATS */
+
+  result->fields.emplace_back("perf", json + "}");
+}
+
+void BenchFeed(const BenchOptions& options, const PerfCounters* counters,
+               std::vector<BenchResult>* results) {
+  const Framing framings[] = {Framing::kRaw, Framing::kZlib, Framing::kGzip};
+  auto corpora = MakeCorpora(options.corpus_size);
+
+  for (const auto& corpus : corpora) {
+    for (auto framing : framings) {
+      auto name = corpus.name + "/" + FramingName(framing);
+      if (!BenchSelected(options, "feed/" + name)) continue;
+
+      auto compressed = CompressCorpus(corpus, framing, options.level);
+      auto truncated = BenchTruncateCorpus(compressed, options.level);
+      auto out = std::vector<unsigned char>(compressed.max_message_size);
+
+      for (int m = kBenchNoChecksum; m <= kBenchVerify; m++) {
+        auto mode = (BenchFeedMode)m;
+        /* raw deflate carries no checksum */
+        if (mode == kBenchChecksum && framing == Framing::kRaw) continue;
+
+        auto result = BenchResult{};
+        result.group = "feed";
+        result.name = name + "/" + kBenchFeedModeNames[mode];
+        result.unit = "bytes";
+        result.units = compressed.original_size;
+        result.verified = BenchVerifyCorpus(compressed, mode, &out) &&
+                          BenchVerifyTruncated(truncated, mode, &out);
+        result.fields.emplace_back("corpus", "\"" + corpus.name + "\"");
+        result.fields.emplace_back(
+            "framing", std::string{"\""} + FramingName(framing) + "\"");
+        result.fields.emplace_back(
+            "mode", std::string{"\""} + kBenchFeedModeNames[mode] + "\"");
+        result.fields.emplace_back(
+            "messages", std::to_string(compressed.compressed.size()));
+        result.fields.emplace_back("compressed_bytes",
+                                   std::to_string(compressed.compressed_size));
+
+        if (result.verified) {
+          auto decompressor = Decompressor{};
+          result.sample =
+              BenchMeasure(options.min_seconds, options.min_iterations,
+                           &result.iterations, [&]() {
+                             return BenchFeedCorpus(compressed, mode, &out,
+                                                    &decompressor);
+                           });
+          if (counters || kInflateStatsEnabled)
+            BenchFeedCounters(compressed, mode, &out, counters, &result);
+        } else {
+          result.iterations = 0;
+          result.sample = BenchSample{0, 0};
+        }
+
+        results->push_back(result);
+      }
+    }
+  }
+}
+
+/*-- ZipReader over asset bundles --*/
+
+/* corpora are cut into entries of this size, like the assets of a bundle */
+constexpr size_t kBenchZipEntrySize = 64 * 1024;
+
+void BenchZipPut16(std::vector<unsigned char>* out, unsigned int value) {
+  out->push_back(value & 0xff);
+  out->push_back((value >> 8) & 0xff);
+}
+
+void BenchZipPut32(std::vector<unsigned char>* out, unsigned int value) {
+  BenchZipPut16(out, value & 0xffff);
+  BenchZipPut16(out, value >> 16);
+}
+
+/**
+ * Build a ZIP archive of a corpus, deflated with the reference encoder
+ *
+ * @param corpus corpus to archive
+ * @param level zlib compression level
+ * @param names receives the names of the entries
+ * @param originals receives the contents of the entries
+ *
+ * @return archive
+ */
+std::vector<unsigned char> BenchZipArchive(
+    const Corpus& corpus, int level, std::vector<std::string>* names,
+    std::vector<std::vector<unsigned char>>* originals) {
+  auto archive = std::vector<unsigned char>{};
+  auto directory = std::vector<unsigned char>{};
+
+  for (const auto& message : corpus.messages) {
+    for (size_t offset = 0; offset < message.size();
+         offset += kBenchZipEntrySize) {
+      size_t size = std::min(kBenchZipEntrySize, message.size() - offset);
+      originals->emplace_back(message.begin() + offset,
+                              message.begin() + offset + size);
+      names->push_back("assets/" + corpus.name + "/" +
+                       std::to_string(names->size()) + ".bin");
+    }
+  }
+
+  for (size_t i = 0; i < names->size(); i++) {
+    const auto& name = (*names)[i];
+    const auto& original = (*originals)[i];
+    auto compressed = CompressMessage(original, Framing::kRaw, level);
+    unsigned int crc32 = Crc32Checksum::Update(
+        Crc32Checksum::Init(), original.data(), original.size());
+    unsigned int local_header_offset = (unsigned int)archive.size();
+
+    for (auto* header : {&archive, &directory}) {
+      bool central = header == &directory;
+      BenchZipPut32(header,
+                    central ? kZipCentralHeaderSig : kZipLocalHeaderSig);
+      if (central) BenchZipPut16(header, 20); /* version made by */
+      BenchZipPut16(header, 20);              /* version needed */
+      BenchZipPut16(header, 0);               /* flags */
+      BenchZipPut16(header, kZipDeflated);
+      BenchZipPut32(header, 0); /* DOS time and date */
+      BenchZipPut32(header, crc32);
+      BenchZipPut32(header, (unsigned int)compressed.size());
+      BenchZipPut32(header, (unsigned int)original.size());
+      BenchZipPut16(header, (unsigned int)name.size());
+      BenchZipPut16(header, 0); /* extra field */
+      if (central) {
+        BenchZipPut16(header, 0); /* comment */
+        BenchZipPut16(header, 0); /* disk */
+        BenchZipPut16(header, 0); /* internal attributes */
+        BenchZipPut32(header, 0); /* external attributes */
+        BenchZipPut32(header, local_header_offset);
+      }
+      header->insert(header->end(), name.begin(), name.end());
+    }
+    archive.insert(archive.end(), compressed.begin(), compressed.end());
+  }
+
+  unsigned int directory_offset = (unsigned int)archive.size();
+  archive.insert(archive.end(), directory.begin(), directory.end());
+  BenchZipPut32(&archive, kZipEndSig);
+  BenchZipPut32(&archive, 0); /* disks */
+  BenchZipPut16(&archive, (unsigned int)names->size());
+  BenchZipPut16(&archive, (unsigned int)names->size());
+  BenchZipPut32(&archive, (unsigned int)directory.size());
+  BenchZipPut32(&archive, directory_offset);
+  BenchZipPut16(&archive, 0); /* comment */
+
+  return archive;
+}
+
+/**
+ * Measure indexing an archive, fetching every entry by name, and
+ * extracting all of them in parallel
+ */
+void BenchZip(const BenchOptions& options, std::vector<BenchResult>* results) {
+  auto corpora = MakeCorpora(options.corpus_size);
+
+  for (const auto& corpus : corpora) {
+    auto names = std::vector<std::string>{};
+    auto originals = std::vector<std::vector<unsigned char>>{};
+    bool built = false;
+    std::vector<unsigned char> archive;
+    std::vector<unsigned char> truncated;
+    size_t original_size = 0;
+
+    for (const char* mode : {"open", "find_extract", "extract_parallel"}) {
+      auto name = corpus.name + "/" + mode;
+      if (!BenchSelected(options, "zip/" + name)) continue;
+
+      if (!built) {
+        archive = BenchZipArchive(corpus, options.level, &names, &originals);
+        for (const auto& original : originals) original_size += original.size();
+        built = true;
+      }
+
+      auto reader = ZipReader{};
+      auto result = BenchResult{};
+      result.group = "zip";
+      result.name = name;
+      result.fields.emplace_back("corpus", "\"" + corpus.name + "\"");
+      result.fields.emplace_back("entries", std::to_string(names.size()));
+      result.fields.emplace_back("archive_bytes",
+                                 std::to_string(archive.size()));
+      result.verified =
+          !reader.OpenMemory(archive.data(), archive.size()) &&
+          reader.GetEntryCount() == names.size();
+
+      std::function<bool()> body;
+      auto decompressor = Decompressor{};
+      auto out = std::vector<unsigned char>(kBenchZipEntrySize);
+      auto entries = std::vector<const ZipEntry*>{};
+      auto outs = std::vector<std::vector<unsigned char>>{};
+
+      if (!std::strcmp(mode, "open")) {
+        result.unit = "entries";
+        result.units = names.size();
+        body = [&]() {
+          return !reader.OpenMemory(archive.data(), archive.size());
+        };
+      } else if (!std::strcmp(mode, "find_extract")) {
+        result.unit = "bytes";
+        result.units = original_size;
+        body = [&]() {
+          for (size_t i = 0; i < names.size(); i++) {
+            const ZipEntry* entry = reader.FindEntry(names[i]);
+            if (!entry) return false;
+            auto extracted =
+                reader.Extract(*entry, out.data(), out.size(), &decompressor);
+            if (!extracted.Ok() || extracted.size != originals[i].size())
+              return false;
+          }
+          return true;
+        };
+        for (size_t i = 0; result.verified && i < names.size(); i++) {
+          const ZipEntry* entry = reader.FindEntry(names[i]);
+          result.verified =
+              entry &&
+              reader.Extract(*entry, out.data(), out.size(), &decompressor)
+                  .Ok() &&
+              !std::memcmp(out.data(), originals[i].data(),
+                           originals[i].size());
+        }
+      } else {
+        result.unit = "bytes";
+        result.units = original_size;
+        for (const auto& entry_name : names)
+          entries.push_back(reader.FindEntry(entry_name));
+        body = [&]() {
+          for (const auto& extracted :
+               reader.ExtractParallel(entries, &outs, 0))
+            if (!extracted.Ok()) return false;
+          return true;
+        };
+        result.verified = result.verified && body() && outs == originals;
+      }
+
+      if (result.verified) {
+        result.sample = BenchMeasure(options.min_seconds,
+                                     options.min_iterations,
+                                     &result.iterations, body);
+      } else {
+        result.iterations = 0;
+        result.sample = BenchSample{0, 0};
+      }
+
+      results->push_back(result);
+    }
+  }
+}
+
+/*-- TarGzReader over pax archives --*/
+
+/* distance between the checkpoints recorded while indexing */
+constexpr size_t kBenchTarCheckpointSpacing = 256 * 1024;
+
+/**
+ * Append a ustar header block
+ *
+ * @param out archive
+ * @param name member name, at most 99 bytes
+ * @param type typeflag
+ * @param size size of the member data, in bytes
+ */
+void BenchTarHeader(std::vector<unsigned char>* out, const std::string& name,
+                    char type, size_t size) {
+  unsigned char header[kTarBlockSize] = {};
+  std::memcpy(header, name.data(), std::min(name.size(), (size_t)99));
+  std::snprintf((char*)header + 100, 8, "%07o", 0644);
+  std::snprintf((char*)header + 108, 8, "%07o", 0);
+  std::snprintf((char*)header + 116, 8, "%07o", 0);
+  std::snprintf((char*)header + 124, 12, "%011llo", (unsigned long long)size);
+  std::snprintf((char*)header + 136, 12, "%011o", 0);
+  header[156] = type;
+  std::memcpy(header + 257, "ustar", 6);
+  std::memcpy(header + 263, "00", 2);
+
+  /* the checksum is computed with its own field as spaces */
+  std::memset(header + 148, ' ', 8);
+  unsigned int checksum = 0;
+  for (auto c : header) checksum += c;
+  std::snprintf((char*)header + 148, 8, "%06o", checksum);
+
+  out->insert(out->end(), header, header + kTarBlockSize);
+}
+
+/** Pad an archive to whole blocks */
+void BenchTarPad(std::vector<unsigned char>* out) {
+  out->resize((out->size() + kTarBlockSize - 1) & ~(size_t)(kTarBlockSize - 1),
+              0);
+}
+
+/**
+ * Format a pax record, whose length prefix counts itself
+ *
+ * @return "<length> <key>=<value>\n"
+ */
+std::string BenchPaxRecord(const std::string& key, const std::string& value) {
+  auto body = " " + key + "=" + value + "\n";
+  auto length = body.size();
+  while (std::to_string(length).size() + body.size() != length) length++;
+  return std::to_string(length) + body;
+}
+
+/**
+ * Build a tar archive of a corpus, cut into members that all carry a pax
+ * header with their path and size
+ *
+ * @param corpus corpus to archive
+ * @param names receives the names of the members
+ * @param originals receives the contents of the members
+ *
+ * @return archive, uncompressed
+ */
+std::vector<unsigned char> BenchTarArchive(
+    const Corpus& corpus, std::vector<std::string>* names,
+    std::vector<std::vector<unsigned char>>* originals) {
+  auto archive = std::vector<unsigned char>{};
+
+  for (const auto& message : corpus.messages) {
+    for (size_t offset = 0; offset < message.size();
+         offset += kBenchZipEntrySize) {
+      size_t size = std::min(kBenchZipEntrySize, message.size() - offset);
+      originals->emplace_back(message.begin() + offset,
+                              message.begin() + offset + size);
+      /* longer than the 100 bytes of the ustar name field */
+      auto name = "assets/" + corpus.name + "/" + std::string(100, 'p') +
+                  "/" + std::to_string(names->size()) + ".bin";
+      names->push_back(name);
+
+      auto records = BenchPaxRecord("path", name) +
+                     BenchPaxRecord("size", std::to_string(size));
+      BenchTarHeader(&archive, "PaxHeader", kTarPaxHeader, records.size());
+      archive.insert(archive.end(), records.begin(), records.end());
+      BenchTarPad(&archive);
+
+      BenchTarHeader(&archive, "member", '0', size);
+      archive.insert(archive.end(), originals->back().begin(),
+                     originals->back().end());
+      BenchTarPad(&archive);
+    }
+  }
+  archive.resize(archive.size() + 2 * kTarBlockSize, 0);
+
+  return archive;
+}
+
+/** Gathers a whole decompressed stream */
+class BenchStreamCollector : public InflateStreamObserver {
+ public:
+  void OnData(const unsigned char* data, size_t size) override {
+    this->data_.insert(this->data_.end(), data, data + size);
+  };
+
+  const std::vector<unsigned char>& GetData() const { return this->data_; };
+
+ private:
+  std::vector<unsigned char> data_;
+};
+
+/**
+ * Measure indexing an archive with checkpoints, and extracting its last
+ * member from the last checkpoint before it. The member is checked against
+ * both its original and a full streaming decode of the archive, and the
+ * archive deflated with Huffman codes only and cut in half has to fail to
+ * open.
+ */
+void BenchTarGz(const BenchOptions& options,
+                std::vector<BenchResult>* results) {
+  auto corpora = MakeCorpora(options.corpus_size);
+
+  for (const auto& corpus : corpora) {
+    auto names = std::vector<std::string>{};
+    auto originals = std::vector<std::vector<unsigned char>>{};
+    bool built = false;
+    std::vector<unsigned char> archive;
+    std::vector<unsigned char> truncated;
+    size_t original_size = 0;
+
+    for (const char* mode : {"open", "extract_last"}) {
+      auto name = corpus.name + "/" + mode;
+      if (!BenchSelected(options, "targz/" + name)) continue;
+
+      if (!built) {
+        auto tar = BenchTarArchive(corpus, &names, &originals);
+        for (const auto& original : originals) original_size += original.size();
+        archive = CompressMessage(tar, Framing::kGzip, options.level);
+        truncated = CompressMessage(tar, Framing::kGzip, options.level, true);
+        truncated.resize(truncated.size() / 2);
+        built = true;
+      }
+
+      auto reader = TarGzReader{};
+      auto result = BenchResult{};
+      result.group = "targz";
+      result.name = name;
+      result.verified =
+          !names.empty() &&
+          !reader.Open(archive.data(), archive.size(),
+                       kBenchTarCheckpointSpacing) &&
+          reader.GetMemberCount() == names.size() &&
+          TarGzReader{}.Open(truncated.data(), truncated.size(),
+                             kBenchTarCheckpointSpacing) < 0;
+      result.fields.emplace_back("corpus", "\"" + corpus.name + "\"");
+      result.fields.emplace_back("members", std::to_string(names.size()));
+      result.fields.emplace_back("checkpoints",
+                                 std::to_string(reader.GetCheckpointCount()));
+      result.fields.emplace_back("archive_bytes",
+                                 std::to_string(archive.size()));
+
+      std::function<bool()> body;
+      auto out = std::vector<unsigned char>{};
+
+      if (!std::strcmp(mode, "open")) {
+        result.unit = "bytes";
+        result.units = original_size;
+        body = [&]() {
+          return !reader.Open(archive.data(), archive.size(),
+                              kBenchTarCheckpointSpacing);
+        };
+      } else {
+        const TarMember* last =
+            result.verified ? reader.FindMember(names.back()) : nullptr;
+        result.unit = "bytes";
+        result.units = last ? last->size : 0;
+        body = [&]() { return reader.Extract(*last, &out).Ok(); };
+
+        auto decompressor = Decompressor{};
+        auto collector = BenchStreamCollector{};
+        result.verified =
+            last && reader.GetCheckpointCount() > 0 && body() &&
+            out == originals.back() &&
+            decompressor
+                .FeedStreaming(archive.data(), archive.size(), &collector,
+                               true)
+                .Ok() &&
+            collector.GetData().size() >= last->offset + last->size &&
+            std::equal(out.begin(), out.end(),
+                       collector.GetData().begin() + last->offset);
+      }
+
+      if (result.verified) {
+        result.sample = BenchMeasure(options.min_seconds,
+                                     options.min_iterations,
+                                     &result.iterations, body);
+      } else {
+        result.iterations = 0;
+        result.sample = BenchSample{0, 0};
+      }
+
+      results->push_back(result);
+    }
+  }
+}
+
+/*-- BgzfReader over blocked gzip files --*/
+
+/* uncompressed bytes per block, as bgzip cuts them */
+constexpr size_t kBenchBgzfBlockData = 0xff00;
+/* bytes read around every block edge */
+constexpr size_t kBenchBgzfEdgeRead = 4096;
+
+/**
+ * Build a BGZF file of a corpus, deflated with the reference encoder, and
+ * ended with the empty EOF block
+ *
+ * @param corpus corpus to compress
+ * @param level zlib compression level
+ * @param original receives the messages of the corpus, back to back
+ *
+ * @return BGZF file, or an empty vector if a block does not fit in 64 KB
+ */
+std::vector<unsigned char> BenchBgzfFile(const Corpus& corpus, int level,
+                                         std::vector<unsigned char>* original) {
+  for (const auto& message : corpus.messages)
+    original->insert(original->end(), message.begin(), message.end());
+
+  auto file = std::vector<unsigned char>{};
+  size_t offset = 0, size;
+  do {
+    size = std::min(kBenchBgzfBlockData, original->size() - offset);
+    auto data = std::vector<unsigned char>(original->begin() + offset,
+                                           original->begin() + offset + size);
+    auto compressed = CompressMessage(data, Framing::kRaw, level);
+    size_t block_size =
+        kBgzfHeaderSize + compressed.size() + kBgzfTrailerSize;
+    if (block_size > kBgzfMaxBlockSize) return {};
+
+    /* gzip header with FEXTRA, and its BC subfield */
+    for (unsigned char c : {0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff})
+      file.push_back(c);
+    BenchZipPut16(&file, 6);
+    file.push_back('B');
+    file.push_back('C');
+    BenchZipPut16(&file, 2);
+    BenchZipPut16(&file, (unsigned int)(block_size - 1));
+    file.insert(file.end(), compressed.begin(), compressed.end());
+    BenchZipPut32(&file, Crc32Checksum::Update(Crc32Checksum::Init(),
+                                               data.data(), data.size()));
+    BenchZipPut32(&file, (unsigned int)size);
+
+    offset += size;
+  } while (size); /* down to the empty EOF block */
+
+  return file;
+}
+
+/**
+ * Measure reads of kBenchBgzfEdgeRead bytes across every block edge, from
+ * virtual offsets, and decoding all blocks in parallel. Reads are checked
+ * against the original, parallel decodes against a serial decode of every
+ * block, on 1 and 3 threads as well as on one per hardware thread.
+ */
+void BenchBgzf(const BenchOptions& options,
+               std::vector<BenchResult>* results) {
+  auto corpora = MakeCorpora(options.corpus_size);
+
+  for (const auto& corpus : corpora) {
+    auto original = std::vector<unsigned char>{};
+    bool built = false;
+    std::vector<unsigned char> file;
+
+    for (const char* mode : {"read_edges", "decode_parallel"}) {
+      auto name = corpus.name + "/" + mode;
+      if (!BenchSelected(options, "bgzf/" + name)) continue;
+
+      if (!built) {
+        file = BenchBgzfFile(corpus, options.level, &original);
+        built = true;
+      }
+
+      auto reader = BgzfReader{};
+      auto result = BenchResult{};
+      result.group = "bgzf";
+      result.name = name;
+      result.unit = "bytes";
+      result.verified = !file.empty() &&
+                        !reader.Open(file.data(), file.size()) &&
+                        reader.GetUncompressedSize() == original.size();
+      result.fields.emplace_back("corpus", "\"" + corpus.name + "\"");
+      result.fields.emplace_back("blocks",
+                                 std::to_string(reader.GetBlockCount()));
+      result.fields.emplace_back("file_bytes", std::to_string(file.size()));
+
+      std::function<bool()> body;
+      auto decompressor = Decompressor{};
+      auto out = std::vector<unsigned char>(original.size());
+      auto starts = std::vector<size_t>{};
+
+      if (!std::strcmp(mode, "read_edges")) {
+        /* every edge between two blocks with data, where the whole read
+         * fits in the file */
+        for (size_t i = 1; i < reader.GetBlockCount(); i++) {
+          const BgzfBlock& block = reader.GetBlock(i);
+          if (block.uncompressed_size &&
+              block.uncompressed_offset >= kBenchBgzfEdgeRead / 2 &&
+              block.uncompressed_offset + kBenchBgzfEdgeRead / 2 <=
+                  original.size())
+            starts.push_back(block.uncompressed_offset -
+                             kBenchBgzfEdgeRead / 2);
+        }
+        /* a file that fits in one block has no edge to read across */
+        if (result.verified && starts.empty()) continue;
+        result.units = starts.size() * kBenchBgzfEdgeRead;
+        body = [&]() {
+          for (size_t start : starts) {
+            auto read = reader.Read(reader.GetVirtualOffset(start), out.data(),
+                                    kBenchBgzfEdgeRead, &decompressor);
+            if (!read.Ok() || read.size != kBenchBgzfEdgeRead) return false;
+          }
+          return true;
+        };
+        for (size_t i = 0; result.verified && i < starts.size(); i++) {
+          auto read = reader.Read(reader.GetVirtualOffset(starts[i]),
+                                  out.data(), kBenchBgzfEdgeRead,
+                                  &decompressor);
+          result.verified =
+              read.Ok() && read.size == kBenchBgzfEdgeRead &&
+              !std::memcmp(out.data(), original.data() + starts[i],
+                           kBenchBgzfEdgeRead);
+        }
+      } else {
+        result.units = original.size();
+        body = [&]() {
+          return reader.DecodeParallel(out.data(), out.size(), 0).Ok();
+        };
+
+        auto serial = std::vector<unsigned char>(original.size());
+        for (size_t i = 0; result.verified && i < reader.GetBlockCount();
+             i++) {
+          const BgzfBlock& block = reader.GetBlock(i);
+          result.verified =
+              reader
+                  .DecodeBlock(i, serial.data() + block.uncompressed_offset,
+                               block.uncompressed_size, &decompressor)
+                  .Ok();
+        }
+        result.verified = result.verified && serial == original;
+        for (unsigned int threads : {1, 3, 0}) {
+          std::fill(out.begin(), out.end(), 0);
+          result.verified =
+              result.verified &&
+              reader.DecodeParallel(out.data(), out.size(), threads).Ok() &&
+              out == serial;
+        }
+      }
+
+      if (result.verified) {
+        result.sample = BenchMeasure(options.min_seconds,
+                                     options.min_iterations,
+                                     &result.iterations, body);
+      } else {
+        result.iterations = 0;
+        result.sample = BenchSample{0, 0};
+      }
+
+      results->push_back(result);
+    }
+  }
+}
+
+/*-- Compressor against the reference encoder --*/
+
+const char* const kBenchEncoderNames[] = {"inflatecpp", "zlib", "parallel"};
+
+/**
+ * Measure compressing every message of the corpora into zlib streams, or
+ * chunked gzip streams for ParallelCompressor, and check that Feed()
+ * restores them
+ */
+void BenchCompress(const BenchOptions& options,
+                   std::vector<BenchResult>* results) {
+  auto corpora = MakeCorpora(options.corpus_size);
+
+  for (const auto& corpus : corpora) {
+    size_t original_size = 0, max_message_size = 0;
+    for (const auto& message : corpus.messages) {
+      original_size += message.size();
+      max_message_size = std::max(max_message_size, message.size());
+    }
+
+    for (int encoder = 0; encoder < 3; encoder++) {
+      auto name = corpus.name + "/" + kBenchEncoderNames[encoder];
+      if (!BenchSelected(options, "compress/" + name)) continue;
+
+      auto compressor = Compressor{};
+      compressor.SetLevel(std::min(std::max(options.level, 0), 9));
+      auto parallel_compressor = ParallelCompressor{};
+      parallel_compressor.SetLevel(compressor.GetLevel());
+      auto compressed = std::vector<unsigned char>{};
+      auto compress = [&](const std::vector<unsigned char>& message) {
+        if (encoder == 0)
+          return compressor.Compress(message.data(), message.size(),
+                                     &compressed, ChecksumType::kZLIB) !=
+                 kDeflateError;
+        if (encoder == 2)
+          return parallel_compressor.Compress(message.data(), message.size(),
+                                              &compressed,
+                                              ChecksumType::kGZIP) != 0;
+        compressed = CompressMessage(message, Framing::kZlib, options.level);
+        return !compressed.empty();
+      };
+
+      auto result = BenchResult{};
+      result.group = "compress";
+      result.name = name;
+      result.unit = "bytes";
+      result.units = original_size;
+      result.verified = true;
+
+      /* one pass to verify and size the output */
+      auto decompressor = Decompressor{};
+      auto out = std::vector<unsigned char>(max_message_size);
+      size_t compressed_size = 0;
+      for (const auto& message : corpus.messages) {
+        if (!compress(message)) {
+          result.verified = false;
+          break;
+        }
+        compressed_size += compressed.size();
+        auto decoded = decompressor.Feed(compressed.data(), compressed.size(),
+                                         out.data(), out.size(), true);
+        result.verified = result.verified && decoded.Ok() &&
+                          decoded.size == message.size() &&
+                          !std::memcmp(out.data(), message.data(),
+                                       message.size());
+      }
+
+      result.fields.emplace_back("corpus", "\"" + corpus.name + "\"");
+      result.fields.emplace_back(
+          "encoder", std::string{"\""} + kBenchEncoderNames[encoder] + "\"");
+      result.fields.emplace_back("level", std::to_string(options.level));
+      result.fields.emplace_back("compressed_bytes",
+                                 std::to_string(compressed_size));
+
+      if (result.verified) {
+        result.sample = BenchMeasure(
+            options.min_seconds, options.min_iterations, &result.iterations,
+            [&]() {
+              for (const auto& message : corpus.messages)
+                if (!compress(message)) return false;
+              return true;
+            });
+      } else {
+        result.iterations = 0;
+        result.sample = BenchSample{0, 0};
+      }
+
+      results->push_back(result);
+    }
+  }
+}
+
+/*-- HuffmanDecoder::ReadValue --*/
+
+/**
+ * Build length-limited Huffman code lengths for the given symbol weights
+ *
+ * @return code lengths, or an empty vector if a length would exceed 15 bits
+ */
+std::vector<unsigned char> BenchHuffmanLengths(
+    const std::vector<unsigned int>& weights) {
+  struct Node {
+    uint64_t weight;
+    int index;
+  };
+  auto compare = [](const Node& a, const Node& b) {
+    return a.weight > b.weight;
+  };
+  std::priority_queue<Node, std::vector<Node>, decltype(compare)> queue(
+      compare);
+  auto parent = std::vector<int>(weights.size() * 2, -1);
+  int next = (int)weights.size();
+
+  for (size_t i = 0; i < weights.size(); i++)
+    queue.push(Node{weights[i], (int)i});
+  while (queue.size() > 1) {
+    auto a = queue.top();
+    queue.pop();
+    auto b = queue.top();
+    queue.pop();
+    parent[a.index] = next;
+    parent[b.index] = next;
+    queue.push(Node{a.weight + b.weight, next++});
+  }
+
+  auto lengths = std::vector<unsigned char>(weights.size());
+  for (size_t i = 0; i < weights.size(); i++) {
+    int depth = 0;
+    for (int n = (int)i; parent[n] >= 0; n = parent[n]) depth++;
+    if (depth > 15) return std::vector<unsigned char>{};
+    lengths[i] = (unsigned char)depth;
+  }
+  return lengths;
+}
+
+/** Encode symbols with canonical, bit-reversed deflate codes */
+std::vector<unsigned char> BenchEncodeSymbols(
+    const std::vector<unsigned char>& lengths,
+    const std::vector<unsigned int>& symbols) {
+  unsigned int bl_count[16] = {0};
+  unsigned int next_code[16] = {0};
+  auto codes = std::vector<unsigned int>(lengths.size());
+
+  for (auto length : lengths) bl_count[length]++;
+  bl_count[0] = 0;
+  for (int bits = 1, code = 0; bits < 16; bits++) {
+    code = (code + bl_count[bits - 1]) << 1;
+    next_code[bits] = code;
+  }
+  for (size_t i = 0; i < lengths.size(); i++) {
+    if (!lengths[i]) continue;
+    unsigned int code = next_code[lengths[i]]++;
+    unsigned int reversed = 0;
+    for (int bit = 0; bit < lengths[i]; bit++)
+      reversed |= ((code >> bit) & 1) << (lengths[i] - 1 - bit);
+    codes[i] = reversed;
+  }
+
+  auto stream = std::vector<unsigned char>{};
+  uint64_t bit_buffer = 0;
+  int bit_count = 0;
+  for (auto symbol : symbols) {
+    bit_buffer |= (uint64_t)codes[symbol] << bit_count;
+    bit_count += lengths[symbol];
+    while (bit_count >= 8) {
+      stream.push_back((unsigned char)bit_buffer);
+      bit_buffer >>= 8;
+      bit_count -= 8;
+    }
+  }
+  stream.push_back((unsigned char)bit_buffer);
+  stream.resize(stream.size() + 16, 0);
+  return stream;
+}
+
+void BenchReadValue(const BenchOptions& options, const char* name,
+                    const std::vector<unsigned int>& weights,
+                    std::vector<BenchResult>* results) {
+  if (!BenchSelected(options, std::string{"kernel/"} + name)) return;
+
+  auto lengths = BenchHuffmanLengths(weights);
+  if (lengths.empty()) return;
+
+  /* draw symbols proportionally to their weights */
+  auto random = CorpusRandom{0x73796d626f6cULL};
+  auto cumulative = std::vector<uint64_t>(weights.size());
+  uint64_t total = 0;
+  for (size_t i = 0; i < weights.size(); i++)
+    cumulative[i] = total += weights[i];
+
+  auto symbols = std::vector<unsigned int>(1 << 20);
+  for (auto& symbol : symbols) {
+    uint64_t pick = random.Next() % total;
+    symbol = (unsigned int)(std::upper_bound(cumulative.begin(),
+                                             cumulative.end(), pick) -
+                            cumulative.begin());
+  }
+  auto stream = BenchEncodeSymbols(lengths, symbols);
+
+  LiteralDecoder decoder;
+  if (decoder.PrepareTable(kLiteralSyms, lengths.data()) < 0 ||
+      decoder.FinalizeTable() < 0)
+    return;
+
+  auto decode = [&](bool verify) {
+    BitReader bit_reader;
+    bit_reader.Init(stream.data(), stream.data() + stream.size());
+    for (auto symbol : symbols) {
+      bit_reader.Refill32();
+      unsigned int value = decoder.ReadValue(&bit_reader);
+      if (verify && value != symbol) return false;
+    }
+    return true;
+  };
+
+  auto result = BenchResult{};
+  result.group = "kernel";
+  result.name = name;
+  result.unit = "symbols";
+  result.units = symbols.size();
+  result.verified = decode(true);
+  int max_length = *std::max_element(lengths.begin(), lengths.end());
+  result.fields.emplace_back("max_code_length", std::to_string(max_length));
+  result.sample =
+      BenchMeasure(options.min_seconds, options.min_iterations,
+                   &result.iterations, [&]() { return decode(false); });
+  results->push_back(result);
+}
+
+/*-- CopyMatch --*/
+
+void BenchCopyMatch(const BenchOptions& options, unsigned int match_offset,
+                    unsigned int match_length,
+                    std::vector<BenchResult>* results) {
+  auto name = "copy_match/offset_" + std::to_string(match_offset) + "/length_" +
+              std::to_string(match_length);
+  if (!BenchSelected(options, "kernel/" + name)) return;
+
+  constexpr size_t kWindow = 32768;
+  constexpr size_t kSize = 1024 * 1024;
+  auto buffer = std::vector<unsigned char>(kWindow + kSize + 16);
+  auto random = CorpusRandom{0x636f7079ULL};
+  for (size_t i = 0; i < kWindow; i++) buffer[i] = (unsigned char)random.Next();
+
+  unsigned char* out_end = buffer.data() + kWindow + kSize;
+  const unsigned char* out_fast_end = buffer.data() + buffer.size() - 15;
+  size_t matches = kSize / match_length;
+
+  auto copy = [&]() {
+    unsigned char* current_out = buffer.data() + kWindow;
+    for (size_t i = 0; i < matches; i++)
+      current_out =
+          CopyMatch(current_out, match_offset, match_length, out_fast_end);
+    return current_out <= out_end;
+  };
+
+  auto result = BenchResult{};
+  result.group = "kernel";
+  result.name = name;
+  result.unit = "bytes";
+  result.units = matches * match_length;
+  result.verified = copy();
+  if (result.verified) {
+    /* every output byte must equal the byte one offset back */
+    for (size_t i = kWindow; i < kWindow + result.units; i++) {
+      if (buffer[i] != buffer[i - match_offset]) result.verified = false;
+    }
+  }
+  result.sample = BenchMeasure(options.min_seconds, options.min_iterations,
+                               &result.iterations, copy);
+  results->push_back(result);
+}
+
+/*-- checksums --*/
+
+struct BenchCrc32Kernel {
+  const char* name;
+  unsigned int features;
+  unsigned int (*function)(const void*, unsigned int, unsigned int);
+};
+
+struct BenchAdler32Kernel {
+  const char* name;
+  unsigned int features;
+  unsigned int (*function)(unsigned int, const unsigned char*, unsigned int);
+};
+
+/** Every checksum variant the host supports, verified against the baseline
+ * over a buffer with odd lengths and alignments */
+void BenchChecksums(const BenchOptions& options,
+                    std::vector<BenchResult>* results) {
+  auto data = MakeRandomCorpus(1024 * 1024).messages[0];
+  unsigned int host_features = DetectCpuFeatures();
+  volatile unsigned int sink = 0;
+
+  const BenchCrc32Kernel crc32_kernels[] = {
+      {"crc32_4bytes", 0, crc32_4bytes},
+#ifdef INFLATECPP_X86_DISPATCH
+      {"crc32_pclmul", kCpuPclmul | kCpuSse41, crc32_pclmul},
+#endif /* INFLATECPP_X86_DISPATCH */
+#ifdef INFLATECPP_ARM_DISPATCH
+      {"crc32_armv8", kCpuArmCrc32, crc32_armv8},
+#endif /* INFLATECPP_ARM_DISPATCH */
+  };
+  const BenchAdler32Kernel adler32_kernels[] = {
+      {"adler32_z", 0, adler32_z},
+#ifdef INFLATECPP_X86_DISPATCH
+      {"adler32_ssse3", kCpuSsse3, adler32_ssse3},
+      {"adler32_avx2", kCpuAvx2, adler32_avx2},
+#endif /* INFLATECPP_X86_DISPATCH */
+  };
+
+  for (const auto& kernel : crc32_kernels) {
+    if ((kernel.features & host_features) != kernel.features ||
+        !BenchSelected(options, std::string{"kernel/"} + kernel.name))
+      continue;
+
+    auto result = BenchResult{};
+    result.group = "kernel";
+    result.name = kernel.name;
+    result.unit = "bytes";
+    result.units = data.size();
+    /* CRC-32 of "123456789" */
+    result.verified = kernel.function("123456789", 9, 0) == 0xcbf43926;
+    for (unsigned int size = 0; size < 1000; size += 7)
+      result.verified &= kernel.function(data.data() + size % 16, size, size) ==
+                         crc32_4bytes(data.data() + size % 16, size, size);
+    result.sample = BenchMeasure(
+        options.min_seconds, options.min_iterations, &result.iterations, [&]() {
+          sink = kernel.function(data.data(), (unsigned int)data.size(), 0);
+          return true;
+        });
+    results->push_back(result);
+  }
+
+  for (const auto& kernel : adler32_kernels) {
+    if ((kernel.features & host_features) != kernel.features ||
+        !BenchSelected(options, std::string{"kernel/"} + kernel.name))
+      continue;
+
+    auto result = BenchResult{};
+    result.group = "kernel";
+    result.name = kernel.name;
+    result.unit = "bytes";
+    result.units = data.size();
+    /* Adler-32 of "Wikipedia" */
+    result.verified =
+        kernel.function(1, (const unsigned char*)"Wikipedia", 9) == 0x11e60398;
+    for (unsigned int size = 0; size < 1000; size += 7)
+      result.verified &= kernel.function(1, data.data() + size % 16, size) ==
+                         adler32_z(1, data.data() + size % 16, size);
+    result.sample = BenchMeasure(
+        options.min_seconds, options.min_iterations, &result.iterations, [&]() {
+          sink = kernel.function(1, data.data(), (unsigned int)data.size());
+          return true;
+        });
+    results->push_back(result);
+  }
+  (void)sink;
+}
+
+void BenchKernels(const BenchOptions& options,
+                  std::vector<BenchResult>* results) {
+  /* fixed-block literal/length code: every code fits the fast table */
+  auto fixed = std::vector<unsigned int>(kLiteralSyms);
+  for (int i = 0; i < kLiteralSyms; i++)
+    fixed[i] = (i < 144 || i >= 280) ? 4 : (i < 256 ? 2 : 8);
+  BenchReadValue(options, "read_value/fixed", fixed, results);
+
+  /* skewed literal statistics, where rare symbols take the slow path */
+  auto skewed = std::vector<unsigned int>(kLiteralSyms);
+  for (int i = 0; i < kLiteralSyms; i++) skewed[i] = 1000000 / (i + 1);
+  BenchReadValue(options, "read_value/skewed", skewed, results);
+
+  const unsigned int offsets[] = {1, 4, 16, 64, 1024, 32768};
+  for (auto offset : offsets) BenchCopyMatch(options, offset, 32, results);
+  BenchCopyMatch(options, 1024, 258, results);
+
+  BenchChecksums(options, results);
+}
+
+bool ParseOption(const char* arg, const char* name, std::string* value) {
+  size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) || arg[len] != '=') return false;
+  *value = arg + len + 1;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  auto options = BenchOptions{};
+
+  for (int i = 1; i < argc; i++) {
+    auto value = std::string{};
+    if (ParseOption(argv[i], "--size", &value)) {
+      options.corpus_size = (size_t)(std::atof(value.c_str()) * 1024 * 1024);
+    } else if (ParseOption(argv[i], "--min-time", &value)) {
+      options.min_seconds = std::atof(value.c_str());
+    } else if (ParseOption(argv[i], "--level", &value)) {
+      options.level = std::atoi(value.c_str());
+    } else if (ParseOption(argv[i], "--filter", &value)) {
+      options.filter = value;
+    } else if (ParseOption(argv[i], "--output", &value)) {
+      options.output = value;
+    } else if (!std::strcmp(argv[i], "--perf")) {
+      options.perf = true;
+    } else if (ParseOption(argv[i], "--cpu-features", &value)) {
+      options.cpu_features =
+          (unsigned int)std::strtoul(value.c_str(), nullptr, 0);
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--size=MiB] [--min-time=seconds] "
+                   "[--level=0..9] [--filter=substring] [--output=file] "
+                   "[--perf] [--cpu-features=mask]\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  ForceInflateCpuFeatures(options.cpu_features);
+
+  auto counters = PerfCounters{};
+  bool counters_available = options.perf && counters.Open();
+  if (options.perf && !counters_available)
+    std::fprintf(stderr, "hardware counters unavailable: %s\n",
+                 counters.GetError().c_str());
+
+  auto results = std::vector<BenchResult>{};
+  BenchFeed(options, counters_available ? &counters : nullptr, &results);
+  BenchZip(options, &results);
+  BenchTarGz(options, &results);
+  BenchBgzf(options, &results);
+  BenchCompress(options, &results);
+  BenchKernels(options, &results);
+
+  for (const auto& result : results) {
+    double seconds = result.sample.seconds;
+    std::fprintf(stderr, "%-48s %10.2f M%s/s%s\n",
+                 (result.group + "/" + result.name).c_str(),
+                 seconds > 0 ? (double)result.units / seconds / 1e6 : 0.0,
+                 result.unit == "bytes" ? "B" : result.unit.c_str(),
+                 result.verified ? "" : "  (FAILED)");
+  }
+
+  FILE* f = stdout;
+  if (!options.output.empty()) {
+    f = std::fopen(options.output.c_str(), "w");
+    if (!f) {
+      std::fprintf(stderr, "cannot open %s\n", options.output.c_str());
+      return 1;
+    }
+  }
+
+  std::fprintf(f, "{\n  \"benchmark\": \"inflatecpp\",\n");
+  std::fprintf(f, "  \"corpus_bytes\": %zu,\n", options.corpus_size);
+  std::fprintf(f, "  \"zlib_level\": %d,\n", options.level);
+#ifdef BENCH_HAS_CYCLE_COUNTER
+  std::fprintf(f, "  \"cycle_counter\": \"tsc\",\n");
+#else
+  std::fprintf(f, "  \"cycle_counter\": null,\n");
+#endif
+  std::fprintf(f, "  \"instrumentation\": %s,\n",
+               kInflateStatsEnabled ? "true" : "false");
+  std::fprintf(f, "  \"cpu_features\": {\"host\": %u, \"used\": %u},\n",
+               DetectCpuFeatures(), GetInflateKernels().features);
+  if (options.perf) {
+    std::fprintf(f, "  \"perf_counters\": {\"available\": %s",
+                 counters_available ? "true" : "false");
+    if (!counters.GetError().empty())
+      std::fprintf(f, ", \"error\": \"%s\"", counters.GetError().c_str());
+    std::fprintf(f, "},\n");
+  }
+  std::fprintf(f, "  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); i++)
+    BenchPrintResult(f, results[i], i + 1 == results.size());
+  std::fprintf(f, "  ]\n}\n");
+
+  if (f != stdout) std::fclose(f);
+
+  bool verified = true;
+  for (const auto& result : results) verified &= result.verified;
+  return verified ? 0 : 2;
+}
@@ -0,0 +1,179 @@
+#ifndef _PERF_COUNTERS_H
+#define _PERF_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif /* defined(__linux__) */
+
+/*-- hardware performance counters (Linux perf_event_open) --*/
+
+enum PerfCounter {
+  kPerfCycles = 0,
+  kPerfInstructions = 1,
+  kPerfBranchMisses = 2,
+  kPerfL1DMisses = 3,
+};
+constexpr int kPerfCounters = 4;
+
+const char* const kPerfCounterNames[kPerfCounters] = {
+    "cycles", "instructions", "branch_misses", "l1d_misses"};
+
+struct PerfValues {
+  uint64_t value[kPerfCounters];
+};
+
+/**
+ * Counts user-space events of the calling thread. Counters that the kernel,
+ * the hypervisor or the permissions (perf_event_paranoid) do not allow are
+ * reported as unavailable instead of failing the benchmark.
+ */
+class PerfCounters {
+ public:
+  PerfCounters();
+  ~PerfCounters();
+
+  bool Open();
+  bool Available() const { return this->leader_fd_ >= 0; };
+  bool Available(int counter) const { return this->index_[counter] >= 0; };
+  const std::string& GetError() const { return this->error_; };
+
+  PerfValues Read() const;
+
+ private:
+  int leader_fd_;
+  int fds_[kPerfCounters];
+  /* position of each counter in a PERF_FORMAT_GROUP read, or -1 */
+  int index_[kPerfCounters];
+  int opened_;
+  std::string error_;
+};
+
+PerfCounters::PerfCounters() {
+  this->leader_fd_ = -1;
+  this->opened_ = 0;
+  for (int i = 0; i < kPerfCounters; i++) {
+    this->fds_[i] = -1;
+    this->index_[i] = -1;
+  }
+}
+
+PerfCounters::~PerfCounters() {
+#if defined(__linux__)
+  for (int i = 0; i < kPerfCounters; i++) {
+    if (this->fds_[i] >= 0) close(this->fds_[i]);
+  }
+#endif /* defined(__linux__) */
+}
+
+/**
+ * Open and start the counters
+ *
+ * @return true if at least one counter is available
+ */
+bool PerfCounters::Open() {
+#if defined(__linux__)
+  const uint32_t types[kPerfCounters] = {
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+      PERF_TYPE_HW_CACHE};
+  const uint64_t configs[kPerfCounters] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_BRANCH_MISSES,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+
+  for (int i = 0; i < kPerfCounters; i++) {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[i];
+    attr.config = configs[i];
+    attr.disabled = this->leader_fd_ < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, this->leader_fd_,
+                          0);
+    if (fd < 0) {
+      if (this->error_.empty())
+        this->error_ = std::string{kPerfCounterNames[i]} + ": " +
+                       std::strerror(errno);
+      continue;
+    }
+
+    this->fds_[i] = fd;
+    this->index_[i] = this->opened_++;
+    if (this->leader_fd_ < 0) this->leader_fd_ = fd;
+  }
+
+  if (this->leader_fd_ < 0) return false;
+
+  ioctl(this->leader_fd_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(this->leader_fd_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return true;
+#else
+  this->error_ = "perf_event_open is only available on Linux";
+  return false;
+#endif /* defined(__linux__) */
+}
+
+/** Read all counters at once; unavailable counters read as 0 */
+PerfValues PerfCounters::Read() const {
+  PerfValues values;
+  std::memset(&values, 0, sizeof(values));
+
+#if defined(__linux__)
+  if (this->leader_fd_ < 0) return values;
+
+  uint64_t data[1 + kPerfCounters];
+  if (read(this->leader_fd_, data, sizeof(data)) < (ssize_t)sizeof(uint64_t))
+    return values;
+
+  for (int i = 0; i < kPerfCounters; i++) {
+    if (this->index_[i] >= 0 && (uint64_t)this->index_[i] < data[0])
+      values.value[i] = data[1 + this->index_[i]];
+  }
+#endif /* defined(__linux__) */
+
+  return values;
+}
+
+inline PerfValues PerfDelta(const PerfValues& start, const PerfValues& end) {
+  PerfValues delta;
+  for (int i = 0; i < kPerfCounters; i++)
+    delta.value[i] = end.value[i] - start.value[i];
+  return delta;
+}
+
+inline void PerfAccumulate(PerfValues* total, const PerfValues& delta) {
+  for (int i = 0; i < kPerfCounters; i++) total->value[i] += delta.value[i];
+}
+
+/**
+ * Format counter values as a JSON object
+ *
+ * @param counters counters the values were read from, for availability
+ * @param values counter values
+ *
+ * @return JSON object, with null for unavailable counters
+ */
+std::string PerfJson(const PerfCounters& counters, const PerfValues& values) {
+  auto json = std::string{"{"};
+  for (int i = 0; i < kPerfCounters; i++) {
+    if (i) json += ", ";
+    json += std::string{"\""} + kPerfCounterNames[i] + "\": ";
+    json += counters.Available(i) ? std::to_string(values.value[i]) : "null";
+  }
+  return json + "}";
+}
+
+#endif /* !_PERF_COUNTERS_H */
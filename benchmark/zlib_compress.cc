@@ -0,0 +1,37 @@
+/*-- reference zlib encoder for the benchmark corpora --*/
+
+#include <zlib.h>
+
+#include <cstring>
+#include <vector>
+
+#include "framing.h"
+
+std::vector<unsigned char> CompressMessage(
+    const std::vector<unsigned char>& data, Framing framing, int level,
+    bool huffman_only) {
+  auto result = std::vector<unsigned char>{};
+  int window_bits = 15;
+  if (framing == Framing::kRaw) window_bits = -15;
+  if (framing == Framing::kGzip) window_bits = 15 + 16;
+
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8,
+                   huffman_only ? Z_HUFFMAN_ONLY : Z_DEFAULT_STRATEGY) != Z_OK)
+    return result;
+
+  result.resize(deflateBound(&stream, (uLong)data.size()));
+  stream.next_in = (Bytef*)data.data();
+  stream.avail_in = (uInt)data.size();
+  stream.next_out = result.data();
+  stream.avail_out = (uInt)result.size();
+
+  if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+    deflateEnd(&stream);
+    return std::vector<unsigned char>{};
+  }
+  result.resize(stream.total_out);
+  deflateEnd(&stream);
+  return result;
+}
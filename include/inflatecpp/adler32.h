@@ -28,6 +28,8 @@
 #include <cstdio>
 #include <iostream>
 
+#include "cpu_features.h"
+
 #define BASE 65521U
 #define NMAX 5552
 
@@ -115,4 +117,158 @@ unsigned int adler32_z(unsigned int adler, const unsigned char* buf,
   return adler | (sum2 << 16);
 }
 
+/**
+ * Finish an Adler-32 after a vectorised run: add the bytes that are left and
+ * reduce both sums
+ */
+unsigned int adler32_tail(unsigned int adler, unsigned long sum2,
+                          const unsigned char* buf, unsigned int len) {
+  while (len--) {
+    adler += *buf++;
+    sum2 += adler;
+  }
+  MOD(adler);
+  MOD(sum2);
+  return adler | (sum2 << 16);
+}
+
+/**
+ * Adler-32 of two runs of bytes, one after the other, from the Adler-32 of
+ * each, as zlib's adler32_combine() does
+ *
+ * @param adler1 Adler-32 of the first run
+ * @param adler2 Adler-32 of the second run
+ * @param len2 length of the second run, in bytes
+ *
+ * @return Adler-32 of both runs
+ */
+unsigned int adler32_combine(unsigned int adler1, unsigned int adler2,
+                             unsigned long long len2) {
+  unsigned int rem = (unsigned int)(len2 % BASE);
+  unsigned long sum1 = adler1 & 0xffff;
+  unsigned long sum2 = (rem * sum1) % BASE;
+
+  sum1 += (adler2 & 0xffff) + BASE - 1;
+  sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + BASE - rem;
+  if (sum1 >= BASE) sum1 -= BASE;
+  if (sum1 >= BASE) sum1 -= BASE;
+  if (sum2 >= ((unsigned long)BASE << 1)) sum2 -= ((unsigned long)BASE << 1);
+  if (sum2 >= BASE) sum2 -= BASE;
+  return (unsigned int)(sum1 | (sum2 << 16));
+}
+
+#ifdef INFLATECPP_X86_DISPATCH
+/* pshufd orders for horizontal sums of 32-bit lanes */
+constexpr int kSwapPairs = _MM_SHUFFLE(2, 3, 0, 1);
+constexpr int kSwapHalves = _MM_SHUFFLE(1, 0, 3, 2);
+
+/**
+ * Adler-32 over 32-byte blocks with SSSE3, after the Chromium zlib kernel:
+ * psadbw sums the bytes, pmaddubsw weighs them by their distance to the end
+ * of the block, and the sum of the previous s1 values is added back as
+ * 32 * s1 per block.
+ */
+__attribute__((target("ssse3"))) unsigned int adler32_ssse3(
+    unsigned int adler, const unsigned char* buf, unsigned int len) {
+  unsigned int sum2 = (adler >> 16) & 0xffff;
+  adler &= 0xffff;
+
+  if (buf == NULL) return 1L;
+
+  const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23,
+                                     22, 21, 20, 19, 18, 17);
+  const __m128i tap2 =
+      _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+  unsigned int blocks = len / 32;
+  len -= blocks * 32;
+
+  while (blocks) {
+    unsigned int n = NMAX / 32;
+    if (n > blocks) n = blocks;
+    blocks -= n;
+
+    __m128i v_ps = _mm_set_epi32(0, 0, 0, adler * n);
+    __m128i v_s2 = _mm_set_epi32(0, 0, 0, sum2);
+    __m128i v_s1 = zero;
+
+    do {
+      const __m128i bytes1 = _mm_loadu_si128((const __m128i*)buf);
+      const __m128i bytes2 = _mm_loadu_si128((const __m128i*)(buf + 16));
+      v_ps = _mm_add_epi32(v_ps, v_s1);
+      v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+      v_s2 = _mm_add_epi32(
+          v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+      v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+      v_s2 = _mm_add_epi32(
+          v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+      buf += 32;
+    } while (--n);
+
+    v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+    v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, kSwapPairs));
+    v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, kSwapHalves));
+    v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, kSwapPairs));
+    v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, kSwapHalves));
+    adler = (adler + (unsigned int)_mm_cvtsi128_si32(v_s1)) % BASE;
+    sum2 = (unsigned int)_mm_cvtsi128_si32(v_s2) % BASE;
+  }
+
+  return adler32_tail(adler, sum2, buf, len);
+}
+
+/** adler32_ssse3() with 32-byte vectors */
+__attribute__((target("avx2"))) unsigned int adler32_avx2(
+    unsigned int adler, const unsigned char* buf, unsigned int len) {
+  unsigned int sum2 = (adler >> 16) & 0xffff;
+  adler &= 0xffff;
+
+  if (buf == NULL) return 1L;
+
+  const __m256i tap = _mm256_setr_epi8(
+      32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15,
+      14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi16(1);
+  unsigned int blocks = len / 32;
+  len -= blocks * 32;
+
+  while (blocks) {
+    unsigned int n = NMAX / 32;
+    if (n > blocks) n = blocks;
+    blocks -= n;
+
+    __m256i v_ps = _mm256_setr_epi32(adler * n, 0, 0, 0, 0, 0, 0, 0);
+    __m256i v_s2 = _mm256_setr_epi32(sum2, 0, 0, 0, 0, 0, 0, 0);
+    __m256i v_s1 = zero;
+
+    do {
+      const __m256i bytes = _mm256_loadu_si256((const __m256i*)buf);
+      v_ps = _mm256_add_epi32(v_ps, v_s1);
+      v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+      v_s2 = _mm256_add_epi32(
+          v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, tap), ones));
+      buf += 32;
+    } while (--n);
+
+    v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 5));
+
+    __m128i s1 = _mm_add_epi32(_mm256_castsi256_si128(v_s1),
+                               _mm256_extracti128_si256(v_s1, 1));
+    __m128i s2 = _mm_add_epi32(_mm256_castsi256_si128(v_s2),
+                               _mm256_extracti128_si256(v_s2, 1));
+    s1 = _mm_add_epi32(s1, _mm_shuffle_epi32(s1, kSwapPairs));
+    s1 = _mm_add_epi32(s1, _mm_shuffle_epi32(s1, kSwapHalves));
+    s2 = _mm_add_epi32(s2, _mm_shuffle_epi32(s2, kSwapPairs));
+    s2 = _mm_add_epi32(s2, _mm_shuffle_epi32(s2, kSwapHalves));
+    adler = (adler + (unsigned int)_mm_cvtsi128_si32(s1)) % BASE;
+    sum2 = (unsigned int)_mm_cvtsi128_si32(s2) % BASE;
+  }
+
+  return adler32_tail(adler, sum2, buf, len);
+}
+#endif /* INFLATECPP_X86_DISPATCH */
+
 #endif /* !_ADLER_32_H */
@@ -0,0 +1,323 @@
+#ifndef _BGZF_READER_H
+#define _BGZF_READER_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "decompressor.h"
+#include "parallel.h"
+
+/*-- BGZF (blocked gzip) reader --*/
+
+/**
+ * BGZF files are series of gzip members of at most 64 KB each way. Every
+ * member carries its own compressed size in a "BC" extra subfield, so the
+ * block boundaries are known from the headers alone, and positions in the
+ * decompressed data are addressed by virtual offsets: the file offset of a
+ * block shifted left by 16, or'ed with an offset into its decompressed
+ * data.
+ */
+
+constexpr auto kBgzfHeaderSize = 18;
+constexpr auto kBgzfTrailerSize = 8;
+constexpr auto kBgzfMaxBlockSize = 65536;
+constexpr auto kBgzfInBlockBits = 16;
+
+/** Block of a BGZF file */
+struct BgzfBlock {
+  size_t compressed_offset;
+  size_t compressed_size;
+  size_t uncompressed_offset;
+  size_t uncompressed_size;
+};
+
+/**
+ * Index of the blocks of a BGZF file in memory. Opening it only walks the
+ * block headers; blocks are decoded on demand, from a virtual offset, or
+ * all of them in parallel.
+ */
+class BgzfReader {
+ public:
+  BgzfReader(){};
+  ~BgzfReader() = default;
+
+  int Open(const void*, size_t);
+
+  size_t GetBlockCount() const { return this->blocks_.size(); };
+  const BgzfBlock& GetBlock(size_t index) const {
+    return this->blocks_[index];
+  };
+  size_t GetUncompressedSize() const { return this->uncompressed_size_; };
+
+  unsigned long long GetVirtualOffset(size_t) const;
+  size_t FindBlock(unsigned long long) const;
+
+  InflateResult DecodeBlock(size_t, unsigned char*, size_t,
+                            Decompressor*) const;
+  InflateResult Read(unsigned long long, unsigned char*, size_t,
+                     Decompressor*) const;
+  InflateResult DecodeParallel(unsigned char*, size_t, unsigned int) const;
+
+ private:
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t uncompressed_size_ = 0;
+  std::vector<BgzfBlock> blocks_;
+  /* block index by compressed offset, for seeks to virtual offsets */
+  std::unordered_map<size_t, size_t> index_;
+};
+
+/**
+ * Make a virtual offset
+ *
+ * @param compressed_offset file offset of a block
+ * @param in_block_offset offset into the decompressed data of the block
+ *
+ * @return virtual offset
+ */
+constexpr unsigned long long MakeBgzfVirtualOffset(
+    size_t compressed_offset, unsigned int in_block_offset) {
+  return ((unsigned long long)compressed_offset << kBgzfInBlockBits) |
+         in_block_offset;
+}
+
+/**
+ * Read the size of a BGZF block from its header
+ *
+ * @param block pointer to start of the block
+ * @param size bytes available from there
+ *
+ * @return size of the whole block, header and trailer included, or -1 if it
+ * is not a BGZF block
+ */
+int ReadBgzfBlockSize(const unsigned char* block, size_t size) {
+  if (size < kBgzfHeaderSize || block[0] != 0x1f || block[1] != 0x8b ||
+      block[2] != 0x08 || !(block[3] & 0x04))
+    return -1;
+
+  /* look for the BC subfield among the extra subfields */
+  size_t extra_size = ((size_t)block[10]) | (((size_t)block[11]) << 8);
+  if (size < 12 + extra_size) return -1;
+
+  const unsigned char* subfield = block + 12;
+  const unsigned char* extra_end = subfield + extra_size;
+  while (extra_end - subfield >= 4) {
+    size_t subfield_size = ((size_t)subfield[2]) | (((size_t)subfield[3]) << 8);
+    if ((size_t)(extra_end - subfield - 4) < subfield_size) return -1;
+
+    if (subfield[0] == 'B' && subfield[1] == 'C' && subfield_size == 2)
+      return (((int)subfield[4]) | (((int)subfield[5]) << 8)) + 1;
+    subfield += 4 + subfield_size;
+  }
+
+  return -1;
+}
+
+/**
+ * Index a BGZF file in memory
+ *
+ * @param data pointer to start of the file; must outlive the reader
+ * @param size size of the file, in bytes
+ *
+ * @return 0 for success, -1 if the file is not a complete series of BGZF
+ * blocks
+ */
+int BgzfReader::Open(const void* data, size_t size) {
+  this->data_ = (const unsigned char*)data;
+  this->size_ = size;
+  this->uncompressed_size_ = 0;
+  this->blocks_.clear();
+  this->index_.clear();
+
+  size_t offset = 0;
+  while (offset < size) {
+    const unsigned char* block = this->data_ + offset;
+    int block_size = ReadBgzfBlockSize(block, size - offset);
+    if (block_size < kBgzfHeaderSize + kBgzfTrailerSize ||
+        (size_t)block_size > size - offset) {
+      this->blocks_.clear();
+      this->index_.clear();
+      return -1;
+    }
+
+    /* ISIZE, in the trailer */
+    size_t uncompressed_size =
+        Crc32Checksum::ReadStored(block + block_size - 4);
+    if (uncompressed_size > kBgzfMaxBlockSize) {
+      this->blocks_.clear();
+      this->index_.clear();
+      return -1;
+    }
+
+    this->index_.emplace(offset, this->blocks_.size());
+    this->blocks_.push_back(BgzfBlock{offset, (size_t)block_size,
+                                      this->uncompressed_size_,
+                                      uncompressed_size});
+    this->uncompressed_size_ += uncompressed_size;
+    offset += block_size;
+  }
+
+  return 0;
+}
+
+/**
+ * Get the virtual offset of a position in the decompressed data
+ *
+ * @param uncompressed_offset position in the decompressed data
+ *
+ * @return virtual offset, or that of the end of the data if the position is
+ * past it
+ */
+unsigned long long BgzfReader::GetVirtualOffset(
+    size_t uncompressed_offset) const {
+  /* the last block that starts at or before the position */
+  auto block = std::upper_bound(
+      this->blocks_.begin(), this->blocks_.end(), uncompressed_offset,
+      [](size_t offset, const BgzfBlock& block) {
+        return offset < block.uncompressed_offset;
+      });
+  if (block == this->blocks_.begin()) return 0;
+  --block;
+
+  size_t in_block_offset = uncompressed_offset - block->uncompressed_offset;
+  if (in_block_offset >= block->uncompressed_size) {
+    /* past the end of the data */
+    return MakeBgzfVirtualOffset(this->size_, 0);
+  }
+  return MakeBgzfVirtualOffset(block->compressed_offset,
+                               (unsigned int)in_block_offset);
+}
+
+/**
+ * Find the block a virtual offset points into, in constant time
+ *
+ * @param virtual_offset virtual offset
+ *
+ * @return block index, or -1 if no block starts at its file offset
+ */
+size_t BgzfReader::FindBlock(unsigned long long virtual_offset) const {
+  auto found = this->index_.find(
+      (size_t)(virtual_offset >> kBgzfInBlockBits));
+  if (found == this->index_.end()) return -1;
+  return found->second;
+}
+
+/**
+ * Decompress one block and verify its CRC32 and size
+ *
+ * @param index block index
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes; the
+ * block's uncompressed_size is always enough
+ * @param decompressor decompressor to use; one per thread
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult BgzfReader::DecodeBlock(size_t index, unsigned char* out,
+                                      size_t out_size_max,
+                                      Decompressor* decompressor) const {
+  const BgzfBlock& block = this->blocks_[index];
+  if (block.uncompressed_size > out_size_max)
+    return {InflateStatus::kDataError, 0};
+
+  InflateResult result =
+      decompressor->Feed(this->data_ + block.compressed_offset,
+                         block.compressed_size, out, out_size_max, true);
+  if (result.Ok() && result.size != block.uncompressed_size)
+    return {InflateStatus::kDataError, 0};
+  return result;
+}
+
+/**
+ * Read decompressed data from a virtual offset on, across blocks
+ *
+ * @param virtual_offset virtual offset to start at
+ * @param out pointer to start of the buffer receiving the data
+ * @param size number of bytes to read
+ * @param decompressor decompressor to use; one per thread
+ *
+ * @return status and number of bytes read, less than size at the end of the
+ * data
+ */
+InflateResult BgzfReader::Read(unsigned long long virtual_offset,
+                               unsigned char* out, size_t size,
+                               Decompressor* decompressor) const {
+  size_t index = this->FindBlock(virtual_offset);
+  size_t in_block_offset =
+      (size_t)(virtual_offset & ((1U << kBgzfInBlockBits) - 1));
+  if (index == (size_t)-1) return {InflateStatus::kDataError, 0};
+  if (in_block_offset > this->blocks_[index].uncompressed_size)
+    return {InflateStatus::kDataError, 0};
+
+  std::unique_ptr<unsigned char[]> scratch;
+  size_t read_size = 0;
+
+  for (; index < this->blocks_.size() && read_size < size; index++) {
+    const BgzfBlock& block = this->blocks_[index];
+    size_t length = block.uncompressed_size - in_block_offset;
+    if (length > size - read_size) length = size - read_size;
+
+    if (!length) {
+      in_block_offset = 0;
+      continue;
+    }
+
+    InflateResult result;
+    if (!in_block_offset && length == block.uncompressed_size) {
+      /* whole block: straight to the output */
+      result = this->DecodeBlock(index, out + read_size, length, decompressor);
+    } else {
+      if (!scratch) scratch.reset(new unsigned char[kBgzfMaxBlockSize]);
+      result = this->DecodeBlock(index, scratch.get(), kBgzfMaxBlockSize,
+                                 decompressor);
+      if (result.Ok())
+        std::memcpy(out + read_size, scratch.get() + in_block_offset, length);
+    }
+    if (!result.Ok()) return result;
+
+    read_size += length;
+    in_block_offset = 0;
+  }
+
+  return {InflateStatus::kOk, read_size};
+}
+
+/**
+ * Decompress the whole file, its blocks spread across a pool of threads,
+ * see ParallelForEach()
+ *
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes;
+ * GetUncompressedSize() is always enough
+ * @param threads number of threads; 0 for one per hardware thread
+ *
+ * @return status and number of bytes decompressed; the status of the first
+ * failed block, if any
+ */
+InflateResult BgzfReader::DecodeParallel(unsigned char* out,
+                                         size_t out_size_max,
+                                         unsigned int threads) const {
+  if (this->uncompressed_size_ > out_size_max)
+    return {InflateStatus::kDataError, 0};
+
+  auto results = std::vector<InflateResult>(
+      this->blocks_.size(), InflateResult{InflateStatus::kOk, 0});
+
+  ParallelForEach<Decompressor>(
+      this->blocks_.size(), threads,
+      [&](size_t i, Decompressor* decompressor) {
+        const BgzfBlock& block = this->blocks_[i];
+        results[i] =
+            this->DecodeBlock(i, out + block.uncompressed_offset,
+                              block.uncompressed_size, decompressor);
+      });
+
+  for (const auto& result : results)
+    if (!result.Ok()) return {result.status, 0};
+  return {InflateStatus::kOk, this->uncompressed_size_};
+}
+
+#endif /* !_BGZF_READER_H */
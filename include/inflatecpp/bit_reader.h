@@ -1,14 +1,20 @@
 #ifndef _BIT_READER_H
 #define _BIT_READER_H
 
+#include <cstddef>
+
+#include "inflate_stats.h"
+
 #if defined(_M_X64) || defined(__x86_64__) || defined(__aarch64__)
 #define X64BIT_SHIFTER
 #endif /* defined(_M_X64) */
 
 #ifdef X64BIT_SHIFTER
 typedef unsigned long long shifter_t;
+constexpr bool kBitReaderRefill32 = true;
 #else
 typedef unsigned int shifter_t;
+constexpr bool kBitReaderRefill32 = false;
 #endif /* X64BIT_SHIFTER */
 
 class BitReader {
@@ -23,12 +29,27 @@ class BitReader {
 
   unsigned int GetBits(const int);
   unsigned int PeekBits();
+  unsigned int GetBufferedBits(const int);
+  unsigned int PeekBufferedBits();
 
   int ByteAllign();
+  size_t GetBitOffset();
+  int SeekBit(size_t);
 
   unsigned char* GetInBlock() { return this->in_block_; };
   unsigned char* GetInBlockEnd() { return this->in_block_end_; };
   unsigned char* GetInBlockStart() { return this->in_block_start_; };
+  /* more bits were consumed than the input holds */
+  bool IsOverrun() { return this->shifter_bit_count_ < 0; };
+
+#ifdef INFLATECPP_ENABLE_STATS
+  void SetStats(InflateStats* stats) { this->stats_ = stats; };
+  InflateStats* GetStats() { return this->stats_; };
+  void SetPhaseObserver(InflatePhaseObserver* observer) {
+    this->observer_ = observer;
+  };
+  InflatePhaseObserver* GetPhaseObserver() { return this->observer_; };
+#endif /* INFLATECPP_ENABLE_STATS */
 
  private:
   int shifter_bit_count_;
@@ -36,6 +57,10 @@ class BitReader {
   unsigned char* in_block_;
   unsigned char* in_block_end_;
   unsigned char* in_block_start_;
+#ifdef INFLATECPP_ENABLE_STATS
+  InflateStats* stats_;
+  InflatePhaseObserver* observer_;
+#endif /* INFLATECPP_ENABLE_STATS */
 };
 
 BitReader::BitReader() {
@@ -44,6 +69,10 @@ BitReader::BitReader() {
   this->in_block_ = nullptr;
   this->in_block_end_ = nullptr;
   this->in_block_start_ = nullptr;
+#ifdef INFLATECPP_ENABLE_STATS
+  this->stats_ = nullptr;
+  this->observer_ = nullptr;
+#endif /* INFLATECPP_ENABLE_STATS */
 }
 
 /**
@@ -64,6 +93,7 @@ void BitReader::Refill32() {
 #ifdef X64BIT_SHIFTER
   if (this->shifter_bit_count_ <= 32 &&
       (this->in_block_ + 4) <= this->in_block_end_) {
+    INFLATE_STATS_ADD(this, refills, 1);
 #if defined(_M_X64) || defined(__x86_64__)
     this->shifter_data_ |= (((shifter_t)(*((unsigned int*)this->in_block_)))
                             << this->shifter_bit_count_);
@@ -107,6 +137,7 @@ void BitReader::ConsumeBits(const int n) {
 unsigned int BitReader::GetBits(const int n) {
   if (this->shifter_bit_count_ < n) {
     if (this->in_block_ < this->in_block_end_) {
+      INFLATE_STATS_ADD(this, byte_refills, 1);
       this->shifter_data_ |=
           (((shifter_t)(*this->in_block_++)) << this->shifter_bit_count_);
       this->shifter_bit_count_ += 8;
@@ -127,25 +158,54 @@ unsigned int BitReader::GetBits(const int n) {
 }
 
 /**
- * Peek at a 16-bit value in the bitstream (lookahead)
+ * Peek at a 16-bit value in the bitstream (lookahead); past the end of the
+ * input, the missing bits are zeros
  *
  * @return value
  */
 unsigned int BitReader::PeekBits() {
   if (this->shifter_bit_count_ < 16) {
     if (this->in_block_ < this->in_block_end_) {
+      INFLATE_STATS_ADD(this, byte_refills, 1);
       this->shifter_data_ |=
           (((shifter_t)(*this->in_block_++)) << this->shifter_bit_count_);
-      if (this->in_block_ < this->in_block_end_)
-        this->shifter_data_ |= (((shifter_t)(*this->in_block_++))
-                                << (this->shifter_bit_count_ + 8));
-      this->shifter_bit_count_ += 16;
+      this->shifter_bit_count_ += 8;
+
+      if (this->in_block_ < this->in_block_end_) {
+        this->shifter_data_ |=
+            (((shifter_t)(*this->in_block_++)) << this->shifter_bit_count_);
+        this->shifter_bit_count_ += 8;
+      }
     }
   }
 
   return this->shifter_data_ & 0xffff;
 }
 
+/**
+ * Read variable bit-length value that is known to be in the shifter already,
+ * e.g. right after Refill32(); no refill and no error check
+ *
+ * @param n size of value in bits (number of bits to read), 0..16
+ *
+ * @return value
+ */
+unsigned int BitReader::GetBufferedBits(const int n) {
+  unsigned int value = this->shifter_data_ & ((1 << n) - 1);
+  this->shifter_data_ >>= n;
+  this->shifter_bit_count_ -= n;
+  return value;
+}
+
+/**
+ * Peek at the next 16 bits of the shifter without refilling it
+ *
+ * @return value
+ */
+unsigned int BitReader::PeekBufferedBits() {
+  return this->shifter_data_ & 0xffff;
+}
+
 /** Re-align bitstream on a byte */
 int BitReader::ByteAllign() {
   while (this->shifter_bit_count_ >= 8) {
@@ -161,4 +221,33 @@ int BitReader::ByteAllign() {
 
 void BitReader::ModifyInBlock(const int v) { this->in_block_ += v; }
 
+/**
+ * Get the position of the next unread bit
+ *
+ * @return position from the start of the input, in bits
+ */
+size_t BitReader::GetBitOffset() {
+  return (size_t)(this->in_block_ - this->in_block_start_) * 8 -
+         this->shifter_bit_count_;
+}
+
+/**
+ * Move to a bit position, dropping the shifter
+ *
+ * @param bit_offset position from the start of the input, in bits
+ *
+ * @return 0 for success, -1 for failure
+ */
+int BitReader::SeekBit(size_t bit_offset) {
+  if ((bit_offset >> 3) > (size_t)(this->in_block_end_ - this->in_block_start_))
+    return -1;
+
+  this->in_block_ = this->in_block_start_ + (bit_offset >> 3);
+  this->shifter_bit_count_ = 0;
+  this->shifter_data_ = 0;
+
+  if ((bit_offset & 7) && this->GetBits(bit_offset & 7) == -1) return -1;
+  return 0;
+}
+
 #endif /* !_BIT_READER_H */
\ No newline at end of file
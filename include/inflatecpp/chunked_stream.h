@@ -0,0 +1,430 @@
+#ifndef _CHUNKED_STREAM_H
+#define _CHUNKED_STREAM_H
+
+#include <algorithm>
+#include <vector>
+
+#include "compressor.h"
+#include "parallel.h"
+
+/*-- chunked deflate streams, compressed and decoded in parallel --*/
+
+/**
+ * A chunked stream is an ordinary raw, zlib or gzip stream whose input was
+ * cut into chunks and compressed on a pool of threads, as pigz does: no
+ * match reaches back into a previous chunk, and every chunk but the last
+ * ends with a sync flush, on a byte boundary. The trailer's checksum is
+ * combined from those of the chunks.
+ *
+ * A gzip stream also lists its chunks in an "IC" subfield of the header's
+ * extra field: the uncompressed size of every chunk but the last (32 bits),
+ * the total uncompressed size (64 bits), then the compressed size of every
+ * chunk (32 bits each), all little-endian. Other decoders skip it and
+ * decode the stream as usual; ChunkedStreamReader locates every chunk from
+ * it and decodes them all in parallel, with no search for block
+ * boundaries.
+ */
+
+constexpr size_t kDefaultChunkSize = 128 * 1024;
+constexpr size_t kMaxChunkSize = (size_t)1 << 30;
+constexpr unsigned char kChunkTableId1 = 'I';
+constexpr unsigned char kChunkTableId2 = 'C';
+/* chunk size and total size, ahead of the compressed sizes */
+constexpr auto kChunkTableHeaderSize = 12;
+/* XLEN is 16 bits wide, and also covers the subfield's own header */
+constexpr auto kMaxChunkTableSize = 65535 - 4;
+
+constexpr auto kGzipHeaderSize = 10;
+constexpr auto kGzipTrailerSize = 8;
+constexpr unsigned char kGzipFlagHcrc = 0x02;
+constexpr unsigned char kGzipFlagExtra = 0x04;
+constexpr unsigned char kGzipFlagName = 0x08;
+constexpr unsigned char kGzipFlagComment = 0x10;
+
+/** Chunk of a chunked stream */
+struct DeflateChunk {
+  size_t compressed_offset;
+  size_t compressed_size;
+  size_t uncompressed_offset;
+  size_t uncompressed_size;
+};
+
+/**
+ * Append an integer, little-endian
+ *
+ * @param out vector to append to
+ * @param value integer
+ * @param bytes number of bytes to write
+ */
+void AppendLittleEndian(std::vector<unsigned char>* out,
+                        unsigned long long value, int bytes) {
+  for (int i = 0; i < bytes; i++)
+    out->push_back((unsigned char)(value >> (8 * i)));
+}
+
+/**
+ * Read a little-endian integer
+ *
+ * @param in pointer to its first byte
+ * @param bytes number of bytes to read
+ *
+ * @return integer
+ */
+unsigned long long ReadLittleEndian(const unsigned char* in, int bytes) {
+  unsigned long long value = 0;
+  for (int i = bytes - 1; i >= 0; i--) value = (value << 8) | in[i];
+  return value;
+}
+
+/** Compressor that spreads the chunks of a stream across threads */
+class ParallelCompressor {
+ public:
+  ParallelCompressor(){};
+  ~ParallelCompressor() = default;
+
+  int SetLevel(int);
+  int GetLevel() const { return this->level_; };
+  int SetChunkSize(size_t);
+  size_t GetChunkSize() const { return this->chunk_size_; };
+  /** Number of threads; 0, the default, for one per hardware thread */
+  void SetThreads(unsigned int threads) { this->threads_ = threads; };
+  /** Whether gzip streams list their chunks in their header; the default */
+  void SetChunkTable(bool chunk_table) { this->chunk_table_ = chunk_table; };
+
+  size_t Compress(const void*, size_t, std::vector<unsigned char>*,
+                  ChecksumType);
+
+ private:
+  int level_ = kDefaultCompressionLevel;
+  size_t chunk_size_ = kDefaultChunkSize;
+  unsigned int threads_ = 0;
+  bool chunk_table_ = true;
+};
+
+/**
+ * Set the compression level
+ *
+ * @param level kMinCompressionLevel to kMaxCompressionLevel
+ *
+ * @return 0 for success, -1 if the level is out of range
+ */
+int ParallelCompressor::SetLevel(int level) {
+  if (level < kMinCompressionLevel || level > kMaxCompressionLevel) return -1;
+  this->level_ = level;
+  return 0;
+}
+
+/**
+ * Set the uncompressed size of the chunks. Smaller chunks spread better
+ * across threads, larger ones compress better, as matches cannot cross
+ * chunks.
+ *
+ * @param chunk_size size, 1 to kMaxChunkSize bytes; kDefaultChunkSize by
+ * default
+ *
+ * @return 0 for success, -1 if the size is out of range
+ */
+int ParallelCompressor::SetChunkSize(size_t chunk_size) {
+  if (!chunk_size || chunk_size > kMaxChunkSize) return -1;
+  this->chunk_size_ = chunk_size;
+  return 0;
+}
+
+/**
+ * Compress a stream, its chunks in parallel, see ParallelForEach()
+ *
+ * @param in pointer to start of the input
+ * @param in_size size of the input, in bytes
+ * @param out receives the compressed stream
+ * @param framing kNone for a raw deflate stream, kZLIB for a zlib stream,
+ * kGZIP for a gzip member, with a chunk table unless disabled, or if it
+ * would not fit in the extra field
+ *
+ * @return compressed size
+ */
+size_t ParallelCompressor::Compress(const void* in, size_t in_size,
+                                    std::vector<unsigned char>* out,
+                                    ChecksumType framing) {
+  const unsigned char* data = (const unsigned char*)in;
+  size_t chunk_count =
+      in_size ? (in_size + this->chunk_size_ - 1) / this->chunk_size_ : 1;
+  auto chunks = std::vector<std::vector<unsigned char>>(chunk_count);
+  auto check_sums = std::vector<unsigned int>(chunk_count, 0);
+
+  ParallelForEach<Compressor>(
+      chunk_count, this->threads_, [&](size_t i, Compressor* compressor) {
+        size_t offset = i * this->chunk_size_;
+        size_t size = std::min(this->chunk_size_, in_size - offset);
+
+        compressor->SetLevel(this->level_);
+        chunks[i].resize(CompressBound(size));
+        chunks[i].resize(compressor->CompressChunk(
+            data + offset, size, chunks[i].data(), chunks[i].size(),
+            i + 1 == chunk_count));
+
+        if (framing == ChecksumType::kGZIP)
+          check_sums[i] =
+              Crc32Checksum::Update(Crc32Checksum::Init(), data + offset, size);
+        else if (framing == ChecksumType::kZLIB)
+          check_sums[i] = Adler32Checksum::Update(Adler32Checksum::Init(),
+                                                  data + offset, size);
+      });
+
+  size_t table_size = kChunkTableHeaderSize + 4 * chunk_count;
+  bool chunk_table = framing == ChecksumType::kGZIP && this->chunk_table_ &&
+                     table_size <= kMaxChunkTableSize;
+
+  out->clear();
+  switch (framing) {
+    case ChecksumType::kGZIP: {
+      unsigned char flags = chunk_table ? kGzipFlagExtra : 0;
+      const unsigned char header[kGzipHeaderSize] = {
+          0x1f, 0x8b, 0x08, flags, 0, 0, 0, 0, GetGzipXfl(this->level_), 0xff};
+      out->insert(out->end(), header, header + kGzipHeaderSize);
+      if (chunk_table) {
+        AppendLittleEndian(out, 4 + table_size, 2);
+        out->push_back(kChunkTableId1);
+        out->push_back(kChunkTableId2);
+        AppendLittleEndian(out, table_size, 2);
+        AppendLittleEndian(out, this->chunk_size_, 4);
+        AppendLittleEndian(out, in_size, 8);
+        for (const auto& chunk : chunks)
+          AppendLittleEndian(out, chunk.size(), 4);
+      }
+      break;
+    }
+    case ChecksumType::kZLIB: {
+      unsigned int header = MakeZlibHeader(this->level_);
+      out->push_back((unsigned char)(header >> 8));
+      out->push_back((unsigned char)header);
+      break;
+    }
+    default:
+      break;
+  }
+
+  for (const auto& chunk : chunks)
+    out->insert(out->end(), chunk.begin(), chunk.end());
+
+  unsigned int check_sum = check_sums[0];
+  for (size_t i = 1; i < chunk_count; i++) {
+    size_t size = std::min(this->chunk_size_, in_size - i * this->chunk_size_);
+    if (framing == ChecksumType::kGZIP)
+      check_sum = crc32_combine(check_sum, check_sums[i], size);
+    else if (framing == ChecksumType::kZLIB)
+      check_sum = adler32_combine(check_sum, check_sums[i], size);
+  }
+
+  if (framing == ChecksumType::kGZIP) {
+    AppendLittleEndian(out, check_sum, 4);
+    AppendLittleEndian(out, in_size & 0xffffffff, 4);
+  } else if (framing == ChecksumType::kZLIB) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+      out->push_back((unsigned char)(check_sum >> shift));
+  }
+
+  return out->size();
+}
+
+/**
+ * Index of the chunks of a gzip stream written by ParallelCompressor, in
+ * memory. Opening it only reads the header's chunk table; chunks are
+ * decoded on demand, or all of them in parallel.
+ */
+class ChunkedStreamReader {
+ public:
+  ChunkedStreamReader(){};
+  ~ChunkedStreamReader() = default;
+
+  int Open(const void*, size_t);
+
+  size_t GetChunkCount() const { return this->chunks_.size(); };
+  const DeflateChunk& GetChunk(size_t index) const {
+    return this->chunks_[index];
+  };
+  size_t GetUncompressedSize() const { return this->uncompressed_size_; };
+
+  InflateResult DecodeChunk(size_t, unsigned char*, size_t,
+                            Decompressor*) const;
+  InflateResult DecodeParallel(unsigned char*, size_t, unsigned int) const;
+
+ private:
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t uncompressed_size_ = 0;
+  /* CRC32 from the trailer */
+  unsigned int check_sum_ = 0;
+  std::vector<DeflateChunk> chunks_;
+};
+
+/**
+ * Index a chunked gzip stream in memory
+ *
+ * @param data pointer to start of the stream; must outlive the reader
+ * @param size size of the stream, in bytes
+ *
+ * @return 0 for success, -1 if the stream is not gzip or has no valid chunk
+ * table; Decompressor::Feed() still decodes it, serially
+ */
+int ChunkedStreamReader::Open(const void* data, size_t size) {
+  const unsigned char* in = (const unsigned char*)data;
+  this->data_ = in;
+  this->size_ = size;
+  this->uncompressed_size_ = 0;
+  this->chunks_.clear();
+
+  if (size < kGzipHeaderSize + 2 + kGzipTrailerSize || in[0] != 0x1f ||
+      in[1] != 0x8b || in[2] != 0x08 || !(in[3] & kGzipFlagExtra))
+    return -1;
+  size_t end = size - kGzipTrailerSize;
+  unsigned char flags = in[3];
+
+  /* find the chunk table among the extra subfields */
+  size_t extra_size = (size_t)ReadLittleEndian(in + kGzipHeaderSize, 2);
+  size_t position = kGzipHeaderSize + 2;
+  if (extra_size > end - position) return -1;
+  size_t extra_end = position + extra_size;
+
+  const unsigned char* table = nullptr;
+  size_t table_size = 0;
+  while (extra_end - position >= 4) {
+    size_t subfield_size = (size_t)ReadLittleEndian(in + position + 2, 2);
+    if (subfield_size > extra_end - position - 4) return -1;
+    if (in[position] == kChunkTableId1 && in[position + 1] == kChunkTableId2) {
+      table = in + position + 4;
+      table_size = subfield_size;
+      break;
+    }
+    position += 4 + subfield_size;
+  }
+  if (!table || table_size < kChunkTableHeaderSize ||
+      (table_size - kChunkTableHeaderSize) % 4)
+    return -1;
+
+  /* then skip the rest of the header */
+  position = extra_end;
+  for (unsigned char flag : {kGzipFlagName, kGzipFlagComment}) {
+    if (!(flags & flag)) continue;
+    while (position < end && in[position]) position++;
+    if (position++ >= end) return -1;
+  }
+  if (flags & kGzipFlagHcrc) position += 2;
+  if (position > end) return -1;
+
+  size_t chunk_size = (size_t)ReadLittleEndian(table, 4);
+  unsigned long long total_size = ReadLittleEndian(table + 4, 8);
+  size_t chunk_count = (table_size - kChunkTableHeaderSize) / 4;
+  if (!chunk_size || !chunk_count ||
+      total_size > (unsigned long long)chunk_size * chunk_count ||
+      (chunk_count > 1 &&
+       total_size <= (unsigned long long)chunk_size * (chunk_count - 1)))
+    return -1;
+  if ((unsigned int)ReadLittleEndian(in + end + 4, 4) !=
+      (unsigned int)total_size)
+    return -1;
+
+  size_t uncompressed_offset = 0;
+  for (size_t i = 0; i < chunk_count; i++) {
+    size_t compressed_size = (size_t)ReadLittleEndian(
+        table + kChunkTableHeaderSize + 4 * i, 4);
+    if (compressed_size > end - position) {
+      this->chunks_.clear();
+      return -1;
+    }
+    size_t uncompressed_size =
+        std::min(chunk_size, (size_t)total_size - uncompressed_offset);
+    this->chunks_.push_back(DeflateChunk{position, compressed_size,
+                                         uncompressed_offset,
+                                         uncompressed_size});
+    position += compressed_size;
+    uncompressed_offset += uncompressed_size;
+  }
+  if (position != end) {
+    this->chunks_.clear();
+    return -1;
+  }
+
+  this->uncompressed_size_ = (size_t)total_size;
+  this->check_sum_ = Crc32Checksum::ReadStored(in + end);
+  return 0;
+}
+
+/**
+ * Decompress one chunk. Its CRC32 is not known on its own; DecodeParallel()
+ * verifies the whole stream's.
+ *
+ * @param index chunk index
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes; the
+ * chunk's uncompressed_size is always enough
+ * @param decompressor decompressor to use; one per thread
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult ChunkedStreamReader::DecodeChunk(
+    size_t index, unsigned char* out, size_t out_size_max,
+    Decompressor* decompressor) const {
+  const DeflateChunk& chunk = this->chunks_[index];
+  if (chunk.uncompressed_size > out_size_max)
+    return {InflateStatus::kDataError, 0};
+
+  InflateResult result = decompressor->FeedRawChunk(
+      this->data_ + chunk.compressed_offset, chunk.compressed_size, out,
+      chunk.uncompressed_size);
+  if (result.Ok() && result.size != chunk.uncompressed_size)
+    return {InflateStatus::kDataError, 0};
+  return result;
+}
+
+/**
+ * Decompress the whole stream, its chunks spread across a pool of threads,
+ * see ParallelForEach(), and verify its CRC32, combined from those of the
+ * chunks
+ *
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes;
+ * GetUncompressedSize() is always enough
+ * @param threads number of threads; 0 for one per hardware thread
+ *
+ * @return status and number of bytes decompressed; the status of the first
+ * failed chunk, if any
+ */
+InflateResult ChunkedStreamReader::DecodeParallel(unsigned char* out,
+                                                  size_t out_size_max,
+                                                  unsigned int threads) const {
+  if (this->uncompressed_size_ > out_size_max)
+    return {InflateStatus::kDataError, 0};
+  /* the decoder does pointer arithmetic on out even for empty streams */
+  unsigned char empty;
+  if (!out) out = &empty;
+
+  auto results = std::vector<InflateResult>(
+      this->chunks_.size(), InflateResult{InflateStatus::kOk, 0});
+  auto check_sums = std::vector<unsigned int>(this->chunks_.size(), 0);
+
+  ParallelForEach<Decompressor>(
+      this->chunks_.size(), threads,
+      [&](size_t i, Decompressor* decompressor) {
+        const DeflateChunk& chunk = this->chunks_[i];
+        unsigned char* chunk_out = out + chunk.uncompressed_offset;
+        results[i] = this->DecodeChunk(i, chunk_out, chunk.uncompressed_size,
+                                       decompressor);
+        if (results[i].Ok())
+          check_sums[i] = Crc32Checksum::Update(
+              Crc32Checksum::Init(), chunk_out, chunk.uncompressed_size);
+      });
+
+  for (const auto& result : results)
+    if (!result.Ok()) return {result.status, 0};
+
+  unsigned int check_sum = check_sums[0];
+  for (size_t i = 1; i < this->chunks_.size(); i++)
+    check_sum = crc32_combine(check_sum, check_sums[i],
+                              this->chunks_[i].uncompressed_size);
+  if (check_sum != this->check_sum_)
+    return {InflateStatus::kChecksumMismatch, 0};
+
+  return {InflateStatus::kOk, this->uncompressed_size_};
+}
+
+#endif /* !_CHUNKED_STREAM_H */
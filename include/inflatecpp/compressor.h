@@ -0,0 +1,1087 @@
+#ifndef _COMPRESSOR_H
+#define _COMPRESSOR_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif /* defined(__SSE2__) */
+
+#include "decompressor.h"
+
+/*-- deflate encoder --*/
+
+/**
+ * Level 0 stores the input. Levels 1 to 3 take the first match they find
+ * (greedy), from a hash table of the last position of every 4-byte string
+ * at level 1, and from hash chains of a few earlier positions at levels 2
+ * and 3. Levels 4 to 9 also search hash chains, ever deeper, and defer each
+ * match by one byte in case the next position starts a longer one (lazy
+ * matching), as zlib does.
+ */
+constexpr auto kMinCompressionLevel = 0;
+constexpr auto kMaxCompressionLevel = 9;
+constexpr auto kDefaultCompressionLevel = 6;
+
+/* Compressors return sizes, or this, when the output buffer is too small */
+constexpr size_t kDeflateError = (size_t)-1;
+
+constexpr auto kLiteralCodes = 286;
+constexpr auto kMaxCodeLength = 15;
+constexpr auto kMaxCodeLenLength = 7;
+constexpr auto kMaxStoredSize = 65535;
+constexpr auto kWindowMask = kWindowSize - 1;
+
+/* hash of the next 4 bytes; fewer bits for small inputs, as the table is
+ * cleared for every stream */
+constexpr auto kHashBytes = 4;
+constexpr auto kMaxHashBits = 15;
+constexpr auto kMinHashBits = 10;
+constexpr size_t kNoPosition = (size_t)-1;
+
+/* symbols per block; the codes are rebuilt for every block */
+constexpr auto kCompressBlockSymbols = 16384;
+
+/* 3-byte matches further than this cost more than three literals */
+constexpr auto kFarMatchOffset = 4096;
+
+constexpr unsigned char kCodeLenOrder[kCodeLenSyms] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+/** Match search parameters of a level, after zlib's configuration table */
+struct CompressionLevel {
+  /* search a quarter of the chain once the previous match is this long */
+  unsigned short good_length;
+  /* lazy levels: only look for a better match below this length; greedy
+   * levels: only hash the positions inside matches up to this length */
+  unsigned short lazy_length;
+  /* stop searching at a match this long */
+  unsigned short nice_length;
+  /* number of candidates to compare */
+  unsigned short max_chain;
+  bool lazy;
+};
+
+constexpr CompressionLevel kCompressionLevels[kMaxCompressionLevel + 1] = {
+    {0, 0, 0, 0, false},         {4, 4, 8, 1, false},
+    {4, 5, 16, 8, false},        {4, 6, 32, 32, false},
+    {4, 4, 16, 16, true},        {8, 16, 32, 32, true},
+    {8, 16, 128, 128, true},     {8, 32, 128, 256, true},
+    {32, 128, 258, 1024, true},  {32, 258, 258, 4096, true},
+};
+
+/** Literal, or match when offset is non-zero */
+struct DeflateSymbol {
+  unsigned short literal_or_length;
+  unsigned short offset;
+};
+
+/**
+ * Maximum compressed size of an input, whatever the level and framing
+ *
+ * @param in_size size of the input, in bytes
+ *
+ * @return size of an output buffer always large enough
+ */
+size_t CompressBound(size_t in_size) {
+  /* stored blocks when nothing compresses, plus headers and trailers */
+  return in_size + (in_size >> 10) + 64;
+}
+
+/**
+ * XFL byte of a gzip header: 2 for the best level, 4 for the fastest one
+ *
+ * @param level compression level
+ *
+ * @return XFL
+ */
+unsigned char GetGzipXfl(int level) {
+  if (level == kMaxCompressionLevel) return 2;
+  if (level == 1) return 4;
+  return 0;
+}
+
+/**
+ * CMF and FLG bytes of a zlib header: a 32 KB window, FLEVEL as zlib sets
+ * it, and FCHECK
+ *
+ * @param level compression level
+ *
+ * @return both bytes, CMF in the upper one
+ */
+unsigned int MakeZlibHeader(int level) {
+  unsigned int flevel = 3;
+  if (level < 2)
+    flevel = 0;
+  else if (level < 6)
+    flevel = 1;
+  else if (level == 6)
+    flevel = 2;
+
+  unsigned int header = (0x78 << 8) | (flevel << 6);
+  return header + 31 - (header % 31);
+}
+
+/**
+ * Floor of the base 2 logarithm
+ *
+ * @param value non-zero value
+ *
+ * @return logarithm
+ */
+unsigned int FloorLog2(unsigned int value) {
+#if defined(__GNUC__)
+  return 31 - __builtin_clz(value);
+#else
+  unsigned int log2 = 0;
+  while (value >>= 1) log2++;
+  return log2;
+#endif /* defined(__GNUC__) */
+}
+
+/**
+ * Length of the common prefix of a match and the current position, 16
+ * bytes at a time with SSE2 or NEON, 8 with a 64-bit XOR elsewhere
+ *
+ * @param match pointer to the match source
+ * @param current pointer to the current position
+ * @param max_length maximum length to compare, in bytes
+ *
+ * @return number of equal bytes
+ */
+size_t MatchLength(const unsigned char* match, const unsigned char* current,
+                   size_t max_length) {
+  size_t length = 0;
+
+#if defined(__SSE2__)
+  while (length + 16 <= max_length) {
+    __m128i equal = _mm_cmpeq_epi8(
+        _mm_loadu_si128((const __m128i*)(match + length)),
+        _mm_loadu_si128((const __m128i*)(current + length)));
+    unsigned int mask = ((unsigned int)_mm_movemask_epi8(equal)) ^ 0xffff;
+    if (mask) return length + __builtin_ctz(mask);
+    length += 16;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  while (length + 16 <= max_length) {
+    uint8x16_t equal =
+        vceqq_u8(vld1q_u8(match + length), vld1q_u8(current + length));
+    /* one nibble per byte */
+    unsigned long long mask = ~vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+    if (mask) return length + (__builtin_ctzll(mask) >> 2);
+    length += 16;
+  }
+#endif /* defined(__SSE2__) */
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (length + 8 <= max_length) {
+    unsigned long long match_word, current_word;
+    std::memcpy(&match_word, match + length, 8);
+    std::memcpy(&current_word, current + length, 8);
+    unsigned long long difference = match_word ^ current_word;
+    if (difference) return length + (__builtin_ctzll(difference) >> 3);
+    length += 8;
+  }
+#endif /* little endian */
+
+  while (length < max_length && match[length] == current[length]) length++;
+  return length;
+}
+
+/**
+ * Compute length-limited Huffman code lengths, with the in-place algorithm
+ * of Moffat and Katajainen, then lengthening the shortest codes past the
+ * limit until the code is complete again. At least two symbols get a code,
+ * so that every code is complete.
+ *
+ * @param freq frequency of every symbol
+ * @param syms number of symbols
+ * @param max_length maximum code length, in bits
+ * @param code_length receives the code length of every symbol, 0 if unused
+ */
+void BuildCodeLengths(const unsigned int* freq, unsigned int syms,
+                      unsigned int max_length, unsigned char* code_length) {
+  /* (frequency, symbol) of the used symbols, rarest first */
+  std::pair<unsigned int, unsigned int> sorted[kLiteralSyms];
+  unsigned int used = 0;
+
+  for (unsigned int i = 0; i < syms; i++) {
+    code_length[i] = 0;
+    if (freq[i]) sorted[used++] = {freq[i], i};
+  }
+  for (unsigned int i = 0; used < 2 && i < syms; i++) {
+    if (!freq[i]) sorted[used++] = {1, i};
+  }
+  std::sort(sorted, sorted + used);
+
+  /* tree: parent links, then depths, overwriting the frequencies */
+  sorted[0].first += sorted[1].first;
+  unsigned int root = 0, leaf = 2;
+  for (unsigned int next = 1; next < used - 1; next++) {
+    if (leaf >= used || sorted[root].first < sorted[leaf].first) {
+      sorted[next].first = sorted[root].first;
+      sorted[root++].first = next;
+    } else {
+      sorted[next].first = sorted[leaf++].first;
+    }
+    if (leaf >= used ||
+        (root < next && sorted[root].first < sorted[leaf].first)) {
+      sorted[next].first += sorted[root].first;
+      sorted[root++].first = next;
+    } else {
+      sorted[next].first += sorted[leaf++].first;
+    }
+  }
+  sorted[used - 2].first = 0;
+  for (int next = (int)used - 3; next >= 0; next--)
+    sorted[next].first = sorted[sorted[next].first].first + 1;
+
+  /* number of codes of every length */
+  unsigned int length_count[kLiteralSyms + 1] = {};
+  int available = 1, depth = 0, node = (int)used - 2, next = (int)used - 1;
+  while (available > 0) {
+    int used_nodes = 0;
+    while (node >= 0 && (int)sorted[node].first == depth) {
+      used_nodes++;
+      node--;
+    }
+    while (available > used_nodes) {
+      length_count[depth]++;
+      next--;
+      available--;
+    }
+    available = 2 * used_nodes;
+    depth++;
+  }
+
+  /* limit the lengths, keeping the Kraft sum at one */
+  for (unsigned int i = max_length + 1; i <= used; i++) {
+    length_count[max_length] += length_count[i];
+    length_count[i] = 0;
+  }
+  unsigned int kraft = 0;
+  for (unsigned int i = 1; i <= max_length; i++)
+    kraft += length_count[i] << (max_length - i);
+  while (kraft > (1U << max_length)) {
+    length_count[max_length]--;
+    for (unsigned int i = max_length - 1; i > 0; i--) {
+      if (length_count[i]) {
+        length_count[i]--;
+        length_count[i + 1] += 2;
+        break;
+      }
+    }
+    kraft--;
+  }
+
+  /* the most frequent symbols get the shortest codes */
+  unsigned int symbol = used;
+  for (unsigned int length = 1; length <= max_length; length++) {
+    for (unsigned int i = length_count[length]; i > 0; i--)
+      code_length[sorted[--symbol].second] = (unsigned char)length;
+  }
+}
+
+/**
+ * Assign canonical codes to code lengths, bit-reversed for LSB-first output
+ *
+ * @param code_length code length of every symbol, 0 if unused
+ * @param syms number of symbols
+ * @param code receives the code of every symbol
+ */
+void BuildCanonicalCodes(const unsigned char* code_length, unsigned int syms,
+                         unsigned short* code) {
+  unsigned int length_count[kMaxCodeLength + 1] = {};
+  unsigned int next_code[kMaxCodeLength + 1] = {};
+
+  for (unsigned int i = 0; i < syms; i++) length_count[code_length[i]]++;
+  length_count[0] = 0;
+  for (unsigned int length = 1; length <= kMaxCodeLength; length++)
+    next_code[length] =
+        (next_code[length - 1] + length_count[length - 1]) << 1;
+
+  for (unsigned int i = 0; i < syms; i++) {
+    unsigned int length = code_length[i];
+    unsigned int value = length ? next_code[length]++ : 0;
+    unsigned int reversed = 0;
+    for (unsigned int j = 0; j < length; j++) {
+      reversed = (reversed << 1) | (value & 1);
+      value >>= 1;
+    }
+    code[i] = (unsigned short)reversed;
+  }
+}
+
+/** Huffman codes of a block */
+struct HuffmanBlockCodes {
+  unsigned short literal_code[kLiteralSyms];
+  unsigned char literal_length[kLiteralSyms];
+  unsigned short offset_code[kOffsetSyms];
+  unsigned char offset_length[kOffsetSyms];
+};
+
+/** Codes of fixed Huffman blocks, and length symbols of match lengths */
+struct DeflateTables {
+  HuffmanBlockCodes fixed;
+  unsigned char length_sym[kMaxMatchSize + 1];
+};
+
+const DeflateTables& GetDeflateTables() {
+  static const DeflateTables tables = []() {
+    DeflateTables tables = {};
+
+    for (unsigned int i = 0; i < kLiteralSyms; i++) {
+      tables.fixed.literal_length[i] =
+          (i < 144) ? 8 : ((i < 256) ? 9 : ((i < 280) ? 7 : 8));
+    }
+    for (unsigned int i = 0; i < kOffsetSyms; i++)
+      tables.fixed.offset_length[i] = 5;
+    BuildCanonicalCodes(tables.fixed.literal_length, kLiteralSyms,
+                        tables.fixed.literal_code);
+    BuildCanonicalCodes(tables.fixed.offset_length, kOffsetSyms,
+                        tables.fixed.offset_code);
+
+    /* the last code overrides 258 in the range of the one before */
+    for (unsigned int i = 0; i < kMatchLenSyms; i++) {
+      unsigned int base = kMatchLenCode[i] & 0x7fff;
+      unsigned int extra_bits = (kMatchLenCode[i] >> 16) & 0xff;
+      for (unsigned int length = base;
+           length < base + (1U << extra_bits) && length <= kMaxMatchSize;
+           length++)
+        tables.length_sym[length] = (unsigned char)i;
+    }
+    return tables;
+  }();
+  return tables;
+}
+
+/**
+ * Offset symbol of a match offset, from the position of its top bit
+ *
+ * @param offset match offset, 1 to kWindowSize
+ *
+ * @return offset symbol
+ */
+unsigned int GetOffsetSym(unsigned int offset) {
+  unsigned int distance = offset - 1;
+  if (distance < 4) return distance;
+  unsigned int log2 = FloorLog2(distance);
+  return (log2 << 1) | ((distance >> (log2 - 1)) & 1);
+}
+
+class BitWriter {
+ public:
+  BitWriter(){};
+  ~BitWriter() = default;
+
+  void Init(unsigned char*, size_t);
+  void PutBits(unsigned int, unsigned int);
+  void ByteAlign();
+  void PutBytes(const unsigned char*, size_t);
+
+  /** Bytes written so far, after ByteAlign() */
+  size_t GetSize() const { return this->out_ - this->out_start_; };
+  bool Overflowed() const { return this->overflow_; };
+
+ private:
+  unsigned char* out_start_ = nullptr;
+  unsigned char* out_ = nullptr;
+  unsigned char* out_end_ = nullptr;
+  unsigned long long bit_buffer_ = 0;
+  unsigned int bit_count_ = 0;
+  /* set once the output does not fit; writes are dropped from then on */
+  bool overflow_ = false;
+};
+
+/**
+ * Initialize bit writer
+ *
+ * @param out pointer to start of output buffer
+ * @param out_size_max maximum size of output buffer, in bytes
+ */
+void BitWriter::Init(unsigned char* out, size_t out_size_max) {
+  this->out_start_ = out;
+  this->out_ = out;
+  this->out_end_ = out + out_size_max;
+  this->bit_buffer_ = 0;
+  this->bit_count_ = 0;
+  this->overflow_ = false;
+}
+
+/**
+ * Append bits, LSB first
+ *
+ * @param value bits to append; no bits set above them
+ * @param bits number of bits, 32 at most
+ */
+void BitWriter::PutBits(unsigned int value, unsigned int bits) {
+  this->bit_buffer_ |= ((unsigned long long)value) << this->bit_count_;
+  this->bit_count_ += bits;
+
+  if (this->bit_count_ >= 32) {
+    if (this->out_end_ - this->out_ >= 4) {
+      this->out_[0] = (unsigned char)this->bit_buffer_;
+      this->out_[1] = (unsigned char)(this->bit_buffer_ >> 8);
+      this->out_[2] = (unsigned char)(this->bit_buffer_ >> 16);
+      this->out_[3] = (unsigned char)(this->bit_buffer_ >> 24);
+      this->out_ += 4;
+    } else {
+      this->overflow_ = true;
+    }
+    this->bit_buffer_ >>= 32;
+    this->bit_count_ -= 32;
+  }
+}
+
+/** Pad to a byte boundary with zero bits, and write all pending bits */
+void BitWriter::ByteAlign() {
+  this->bit_count_ = (this->bit_count_ + 7) & ~7U;
+  while (this->bit_count_) {
+    if (this->out_ < this->out_end_)
+      *this->out_++ = (unsigned char)this->bit_buffer_;
+    else
+      this->overflow_ = true;
+    this->bit_buffer_ >>= 8;
+    this->bit_count_ -= 8;
+  }
+}
+
+/**
+ * Append bytes, after ByteAlign()
+ *
+ * @param data pointer to start of the bytes
+ * @param size number of bytes
+ */
+void BitWriter::PutBytes(const unsigned char* data, size_t size) {
+  if ((size_t)(this->out_end_ - this->out_) < size) {
+    this->overflow_ = true;
+    return;
+  }
+  if (size) std::memcpy(this->out_, data, size);
+  this->out_ += size;
+}
+
+/**
+ * In-memory deflate encoder, producing raw, zlib or gzip streams that
+ * Decompressor::Feed() decodes. Blocks are coded with dynamic or fixed
+ * Huffman codes, or stored, whichever is the smallest.
+ */
+class Compressor {
+ public:
+  Compressor(){};
+  explicit Compressor(int level) { this->SetLevel(level); };
+  ~Compressor() = default;
+
+  int SetLevel(int);
+  int GetLevel() const { return this->level_; };
+
+  size_t Compress(const void*, size_t, unsigned char*, size_t, ChecksumType);
+  size_t Compress(const void*, size_t, std::vector<unsigned char>*,
+                  ChecksumType);
+  size_t CompressChunk(const void*, size_t, unsigned char*, size_t, bool);
+
+ private:
+  int level_ = kDefaultCompressionLevel;
+  /* input of the current stream */
+  const unsigned char* in_ = nullptr;
+  size_t in_size_ = 0;
+  BitWriter bit_writer_;
+
+  /* symbols of the current block, the input range they cover, and their
+   * frequencies */
+  std::unique_ptr<DeflateSymbol[]> symbols_;
+  size_t symbol_count_ = 0;
+  size_t block_start_ = 0;
+  size_t block_end_ = 0;
+  unsigned int literal_freq_[kLiteralSyms] = {};
+  unsigned int offset_freq_[kOffsetSyms] = {};
+
+  /* last position of every hash, and the previous position of the same
+   * hash for every window position; allocated on first use */
+  std::unique_ptr<size_t[]> head_;
+  std::unique_ptr<size_t[]> prev_;
+  unsigned int hash_bits_ = kMaxHashBits;
+  bool chains_ = false;
+
+  size_t InsertHash(size_t);
+  size_t FindMatch(size_t, size_t, size_t, const CompressionLevel&,
+                   size_t*) const;
+  void PutLiteral(unsigned char);
+  void PutMatch(size_t, size_t);
+  void FlushBlock(bool);
+  void WriteStored(const unsigned char*, size_t, bool);
+  void WriteSymbols(const HuffmanBlockCodes&);
+  void DeflateStream(bool);
+  void DeflateGreedy(const CompressionLevel&);
+  void DeflateLazy(const CompressionLevel&);
+};
+
+/**
+ * Set the compression level
+ *
+ * @param level kMinCompressionLevel to kMaxCompressionLevel
+ *
+ * @return 0 for success, -1 if the level is out of range
+ */
+int Compressor::SetLevel(int level) {
+  if (level < kMinCompressionLevel || level > kMaxCompressionLevel) return -1;
+  this->level_ = level;
+  return 0;
+}
+
+/**
+ * Hash the 4 bytes at a position, and make it the last position of its hash
+ *
+ * @param position position in the input, with 4 bytes left from there
+ *
+ * @return previous last position of the hash, or kNoPosition
+ */
+size_t Compressor::InsertHash(size_t position) {
+  unsigned int bytes;
+  std::memcpy(&bytes, this->in_ + position, kHashBytes);
+  unsigned int hash = (bytes * 0x9e3779b1U) >> (32 - this->hash_bits_);
+
+  size_t candidate = this->head_[hash];
+  this->head_[hash] = position;
+  if (this->chains_) this->prev_[position & kWindowMask] = candidate;
+  return candidate;
+}
+
+/**
+ * Find the longest match for a position along its hash chain
+ *
+ * @param position position in the input
+ * @param candidate first candidate, from InsertHash()
+ * @param prev_length length of the match to beat
+ * @param params search parameters
+ * @param offset receives the offset of the match found
+ *
+ * @return length of the match found, or prev_length if none is longer
+ */
+size_t Compressor::FindMatch(size_t position, size_t candidate,
+                             size_t prev_length,
+                             const CompressionLevel& params,
+                             size_t* offset) const {
+  const unsigned char* current = this->in_ + position;
+  size_t max_length = this->in_size_ - position;
+  if (max_length > kMaxMatchSize) max_length = kMaxMatchSize;
+  size_t nice_length = params.nice_length;
+  if (nice_length > max_length) nice_length = max_length;
+  size_t limit = (position > kWindowSize) ? position - kWindowSize : 0;
+
+  size_t best_length = prev_length;
+  unsigned int chain = params.max_chain;
+  if (prev_length >= params.good_length) chain >>= 2;
+  if (!chain) chain = 1;
+
+  while (candidate != kNoPosition && candidate >= limit && best_length <
+         max_length) {
+    const unsigned char* match = this->in_ + candidate;
+
+    /* the byte that would make the match longer rejects most candidates */
+    if (match[best_length] == current[best_length]) {
+      size_t length = MatchLength(match, current, max_length);
+      if (length > best_length) {
+        best_length = length;
+        *offset = position - candidate;
+        if (length >= nice_length) break;
+      }
+    }
+
+    if (!--chain || !this->chains_) break;
+    size_t next = this->prev_[candidate & kWindowMask];
+    /* the entry was reused by a position one window later */
+    if (next == kNoPosition || next >= candidate) break;
+    candidate = next;
+  }
+
+  return best_length;
+}
+
+/**
+ * Add a literal to the current block
+ *
+ * @param literal literal byte
+ */
+void Compressor::PutLiteral(unsigned char literal) {
+  this->symbols_[this->symbol_count_++] = DeflateSymbol{literal, 0};
+  this->literal_freq_[literal]++;
+  this->block_end_++;
+  if (this->symbol_count_ == kCompressBlockSymbols) this->FlushBlock(false);
+}
+
+/**
+ * Add a match to the current block
+ *
+ * @param length match length, kMinMatchSize to kMaxMatchSize
+ * @param offset match offset, 1 to kWindowSize
+ */
+void Compressor::PutMatch(size_t length, size_t offset) {
+  this->symbols_[this->symbol_count_++] =
+      DeflateSymbol{(unsigned short)length, (unsigned short)offset};
+  this->literal_freq_[kMatchLenSymStart +
+                      GetDeflateTables().length_sym[length]]++;
+  this->offset_freq_[GetOffsetSym((unsigned int)offset)]++;
+  this->block_end_ += length;
+  if (this->symbol_count_ == kCompressBlockSymbols) this->FlushBlock(false);
+}
+
+/**
+ * Write input bytes as stored blocks
+ *
+ * @param data pointer to start of the bytes
+ * @param size number of bytes
+ * @param final true to make the last block the final one of the stream
+ */
+void Compressor::WriteStored(const unsigned char* data, size_t size,
+                             bool final) {
+  do {
+    size_t stored_size = (size > kMaxStoredSize) ? kMaxStoredSize : size;
+    size -= stored_size;
+
+    this->bit_writer_.PutBits((final && !size) ? 1 : 0, 3);
+    this->bit_writer_.ByteAlign();
+    this->bit_writer_.PutBits((unsigned int)stored_size, 16);
+    this->bit_writer_.PutBits((unsigned int)(~stored_size & 0xffff), 16);
+    this->bit_writer_.ByteAlign();
+    this->bit_writer_.PutBytes(data, stored_size);
+    data += stored_size;
+  } while (size);
+}
+
+/**
+ * Write the symbols of the current block, and its end-of-block marker
+ *
+ * @param codes Huffman codes of the block
+ */
+void Compressor::WriteSymbols(const HuffmanBlockCodes& codes) {
+  const DeflateTables& tables = GetDeflateTables();
+
+  for (size_t i = 0; i < this->symbol_count_; i++) {
+    const DeflateSymbol& symbol = this->symbols_[i];
+
+    if (!symbol.offset) {
+      this->bit_writer_.PutBits(codes.literal_code[symbol.literal_or_length],
+                                codes.literal_length[symbol.literal_or_length]);
+      continue;
+    }
+
+    /* code and extra bits in a single write, 28 bits at most */
+    unsigned int length_sym = tables.length_sym[symbol.literal_or_length];
+    unsigned int length_code = kMatchLenCode[length_sym];
+    unsigned int literal_sym = kMatchLenSymStart + length_sym;
+    unsigned int code_length = codes.literal_length[literal_sym];
+    this->bit_writer_.PutBits(
+        codes.literal_code[literal_sym] |
+            ((symbol.literal_or_length - (length_code & 0x7fff))
+             << code_length),
+        code_length + ((length_code >> 16) & 0xff));
+
+    unsigned int offset_sym = GetOffsetSym(symbol.offset);
+    unsigned int offset_code = kOffsetCode[offset_sym];
+    code_length = codes.offset_length[offset_sym];
+    this->bit_writer_.PutBits(
+        codes.offset_code[offset_sym] |
+            ((symbol.offset - (offset_code & 0xffff)) << code_length),
+        code_length + (offset_code >> 16));
+  }
+
+  this->bit_writer_.PutBits(codes.literal_code[kEODMarkerSym],
+                            codes.literal_length[kEODMarkerSym]);
+}
+
+/**
+ * Write the current block with dynamic or fixed Huffman codes, or stored,
+ * whichever is the smallest, and start the next one
+ *
+ * @param final true if this is the final block of the stream
+ */
+void Compressor::FlushBlock(bool final) {
+  const DeflateTables& tables = GetDeflateTables();
+  this->literal_freq_[kEODMarkerSym]++;
+
+  /* dynamic codes, trimmed of the unused trailing symbols */
+  HuffmanBlockCodes codes = {};
+  BuildCodeLengths(this->literal_freq_, kLiteralCodes, kMaxCodeLength,
+                   codes.literal_length);
+  BuildCodeLengths(this->offset_freq_, kOffsetCodes, kMaxCodeLength,
+                   codes.offset_length);
+  unsigned int literal_syms = kLiteralCodes;
+  while (literal_syms > kMatchLenSymStart &&
+         !codes.literal_length[literal_syms - 1])
+    literal_syms--;
+  unsigned int offset_syms = kOffsetCodes;
+  while (offset_syms > 1 && !codes.offset_length[offset_syms - 1])
+    offset_syms--;
+
+  /* run-length code both sets of lengths as one sequence */
+  unsigned char code_length[kLiteralCodes + kOffsetCodes];
+  std::memcpy(code_length, codes.literal_length, literal_syms);
+  std::memcpy(code_length + literal_syms, codes.offset_length, offset_syms);
+  unsigned int lengths = literal_syms + offset_syms;
+
+  /* code length symbol, and its repeat count in the upper byte */
+  unsigned short runs[kLiteralCodes + kOffsetCodes];
+  unsigned int run_count = 0;
+  unsigned int code_len_freq[kCodeLenSyms] = {};
+  for (unsigned int i = 0; i < lengths;) {
+    unsigned int length = code_length[i];
+    unsigned int run = 1;
+    while (i + run < lengths && code_length[i + run] == length) run++;
+    i += run;
+
+    if (!length) {
+      while (run >= 11) {
+        unsigned int repeat = (run > 138) ? 138 : run;
+        runs[run_count++] = (unsigned short)(18 | ((repeat - 11) << 8));
+        run -= repeat;
+      }
+      if (run >= 3) {
+        runs[run_count++] = (unsigned short)(17 | ((run - 3) << 8));
+        run = 0;
+      }
+    } else {
+      runs[run_count++] = (unsigned short)length;
+      run--;
+      while (run >= 3) {
+        unsigned int repeat = (run > 6) ? 6 : run;
+        runs[run_count++] = (unsigned short)(16 | ((repeat - 3) << 8));
+        run -= repeat;
+      }
+    }
+    while (run--) runs[run_count++] = (unsigned short)length;
+  }
+  for (unsigned int i = 0; i < run_count; i++) code_len_freq[runs[i] & 0xff]++;
+
+  unsigned char code_len_length[kCodeLenSyms];
+  unsigned short code_len_code[kCodeLenSyms];
+  BuildCodeLengths(code_len_freq, kCodeLenSyms, kMaxCodeLenLength,
+                   code_len_length);
+  BuildCanonicalCodes(code_len_length, kCodeLenSyms, code_len_code);
+  unsigned int code_len_syms = kCodeLenSyms;
+  while (code_len_syms > 4 &&
+         !code_len_length[kCodeLenOrder[code_len_syms - 1]])
+    code_len_syms--;
+
+  /* sizes of the three encodings, in bits */
+  static constexpr unsigned int kRepeatBits[3] = {2, 3, 7};
+  size_t extra_bits = 0, dynamic_bits = 3 + 5 + 5 + 4 + 3 * code_len_syms,
+         fixed_bits = 3;
+  for (unsigned int i = 0; i < kCodeLenSyms; i++) {
+    unsigned int repeat_bits = (i >= 16) ? kRepeatBits[i - 16] : 0;
+    dynamic_bits +=
+        (size_t)code_len_freq[i] * (code_len_length[i] + repeat_bits);
+  }
+  for (unsigned int i = 0; i < kLiteralCodes; i++) {
+    dynamic_bits += (size_t)this->literal_freq_[i] * codes.literal_length[i];
+    fixed_bits +=
+        (size_t)this->literal_freq_[i] * tables.fixed.literal_length[i];
+  }
+  for (unsigned int i = 0; i < kMatchLenSyms; i++) {
+    extra_bits += (size_t)this->literal_freq_[kMatchLenSymStart + i] *
+                  ((kMatchLenCode[i] >> 16) & 0xff);
+  }
+  for (unsigned int i = 0; i < kOffsetCodes; i++) {
+    dynamic_bits += (size_t)this->offset_freq_[i] * codes.offset_length[i];
+    fixed_bits += (size_t)this->offset_freq_[i] * 5;
+    extra_bits += (size_t)this->offset_freq_[i] * (kOffsetCode[i] >> 16);
+  }
+  dynamic_bits += extra_bits;
+  fixed_bits += extra_bits;
+
+  size_t block_size = this->block_end_ - this->block_start_;
+  size_t stored_blocks = (block_size + kMaxStoredSize - 1) / kMaxStoredSize;
+  size_t stored_bits =
+      (block_size + 5 * std::max((size_t)1, stored_blocks)) * 8;
+
+  if (stored_bits <= fixed_bits && stored_bits <= dynamic_bits) {
+    this->WriteStored(this->in_ + this->block_start_, block_size, final);
+  } else if (fixed_bits <= dynamic_bits) {
+    this->bit_writer_.PutBits((final ? 1 : 0) | (1 << 1), 3);
+    this->WriteSymbols(tables.fixed);
+  } else {
+    BuildCanonicalCodes(codes.literal_length, kLiteralSyms,
+                        codes.literal_code);
+    BuildCanonicalCodes(codes.offset_length, kOffsetSyms, codes.offset_code);
+
+    this->bit_writer_.PutBits((final ? 1 : 0) | (2 << 1), 3);
+    this->bit_writer_.PutBits(literal_syms - kMatchLenSymStart, 5);
+    this->bit_writer_.PutBits(offset_syms - 1, 5);
+    this->bit_writer_.PutBits(code_len_syms - 4, 4);
+    for (unsigned int i = 0; i < code_len_syms; i++)
+      this->bit_writer_.PutBits(code_len_length[kCodeLenOrder[i]],
+                                kCodeLenBits);
+    for (unsigned int i = 0; i < run_count; i++) {
+      unsigned int sym = runs[i] & 0xff;
+      this->bit_writer_.PutBits(code_len_code[sym], code_len_length[sym]);
+      if (sym >= 16)
+        this->bit_writer_.PutBits(runs[i] >> 8, kRepeatBits[sym - 16]);
+    }
+    this->WriteSymbols(codes);
+  }
+
+  this->symbol_count_ = 0;
+  this->block_start_ = this->block_end_;
+  std::memset(this->literal_freq_, 0, sizeof(this->literal_freq_));
+  std::memset(this->offset_freq_, 0, sizeof(this->offset_freq_));
+}
+
+/**
+ * Levels 1 to 3: take the first match found at every position
+ *
+ * @param params search parameters
+ */
+void Compressor::DeflateGreedy(const CompressionLevel& params) {
+  size_t position = 0;
+  size_t hash_end =
+      (this->in_size_ >= kHashBytes) ? this->in_size_ - kHashBytes + 1 : 0;
+
+  while (position < this->in_size_) {
+    size_t length = 0, offset = 0;
+    if (position < hash_end) {
+      size_t candidate = this->InsertHash(position);
+      length = this->FindMatch(position, candidate, kMinMatchSize - 1,
+                               params, &offset);
+      if (length == kMinMatchSize && offset > kFarMatchOffset) length = 0;
+    }
+
+    if (length < kMinMatchSize) {
+      this->PutLiteral(this->in_[position++]);
+      continue;
+    }
+
+    this->PutMatch(length, offset);
+    size_t match_end = position + length;
+    if (length <= params.lazy_length) {
+      for (position++; position < match_end && position < hash_end; position++)
+        this->InsertHash(position);
+    }
+    position = match_end;
+  }
+}
+
+/**
+ * Levels 4 to 9: emit a match only if the next position does not start a
+ * longer one, otherwise a literal and the longer match
+ *
+ * @param params search parameters
+ */
+void Compressor::DeflateLazy(const CompressionLevel& params) {
+  size_t position = 0;
+  size_t hash_end =
+      (this->in_size_ >= kHashBytes) ? this->in_size_ - kHashBytes + 1 : 0;
+  size_t prev_length = kMinMatchSize - 1, prev_offset = 0;
+  bool match_available = false;
+
+  while (position < this->in_size_) {
+    size_t length = kMinMatchSize - 1, offset = 0;
+    if (position < hash_end) {
+      size_t candidate = this->InsertHash(position);
+      if (prev_length < params.lazy_length) {
+        length = this->FindMatch(position, candidate, prev_length, params,
+                                 &offset);
+        if (length == prev_length ||
+            (length == kMinMatchSize && offset > kFarMatchOffset))
+          length = kMinMatchSize - 1;
+      }
+    }
+
+    if (prev_length >= kMinMatchSize && length <= prev_length) {
+      /* the previous position's match wins; it started one byte back */
+      this->PutMatch(prev_length, prev_offset);
+      size_t match_end = position - 1 + prev_length;
+      for (position++; position < match_end && position < hash_end; position++)
+        this->InsertHash(position);
+      position = match_end;
+      match_available = false;
+      prev_length = kMinMatchSize - 1;
+    } else {
+      if (match_available) this->PutLiteral(this->in_[position - 1]);
+      match_available = true;
+      prev_length = length;
+      prev_offset = offset;
+      position++;
+    }
+  }
+
+  if (match_available) this->PutLiteral(this->in_[this->in_size_ - 1]);
+}
+
+/**
+ * Deflate the whole input into the bit writer, and leave it byte-aligned
+ *
+ * @param final true to end with the final block; false to end with a sync
+ * flush, an empty stored block, so that more deflate data can follow
+ */
+void Compressor::DeflateStream(bool final) {
+  const CompressionLevel& params = kCompressionLevels[this->level_];
+
+  if (!this->level_) {
+    /* stored blocks end on a flush point already */
+    this->WriteStored(this->in_, this->in_size_, final);
+    this->bit_writer_.ByteAlign();
+    return;
+  }
+
+  /* a table only as large as the input needs, as it is cleared */
+  this->hash_bits_ = kMinHashBits;
+  while (this->hash_bits_ < kMaxHashBits &&
+         ((size_t)1 << this->hash_bits_) < this->in_size_)
+    this->hash_bits_++;
+  if (!this->head_) this->head_.reset(new size_t[1 << kMaxHashBits]);
+  std::fill(this->head_.get(), this->head_.get() + (1 << this->hash_bits_),
+            kNoPosition);
+  this->chains_ = params.max_chain > 1;
+  if (this->chains_ && !this->prev_)
+    this->prev_.reset(new size_t[kWindowSize]);
+  if (!this->symbols_)
+    this->symbols_.reset(new DeflateSymbol[kCompressBlockSymbols]);
+
+  this->symbol_count_ = 0;
+  this->block_start_ = 0;
+  this->block_end_ = 0;
+  std::memset(this->literal_freq_, 0, sizeof(this->literal_freq_));
+  std::memset(this->offset_freq_, 0, sizeof(this->offset_freq_));
+
+  if (params.lazy)
+    this->DeflateLazy(params);
+  else
+    this->DeflateGreedy(params);
+  this->FlushBlock(final);
+  if (!final) this->WriteStored(this->in_, 0, false);
+  this->bit_writer_.ByteAlign();
+}
+
+/**
+ * Compress a chunk of a raw deflate stream. The chunk shares no matches
+ * with the others and ends on a byte boundary, so that chunks compressed
+ * separately, e.g. on different threads, concatenate into one stream, and
+ * Decompressor::FeedRawChunk() decodes each of them separately too.
+ *
+ * @param in pointer to start of the chunk's input
+ * @param in_size size of the chunk's input, in bytes
+ * @param out pointer to start of output buffer
+ * @param out_size_max maximum size of output buffer, in bytes;
+ * CompressBound() is always enough
+ * @param final true for the last chunk of the stream, which ends with the
+ * final block; the others end with a sync flush
+ *
+ * @return compressed size, or kDeflateError if the output buffer is too
+ * small
+ */
+size_t Compressor::CompressChunk(const void* in, size_t in_size,
+                                 unsigned char* out, size_t out_size_max,
+                                 bool final) {
+  this->in_ = (const unsigned char*)in;
+  this->in_size_ = in_size;
+  this->bit_writer_.Init(out, out_size_max);
+
+  this->DeflateStream(final);
+
+  this->in_ = nullptr;
+  this->in_size_ = 0;
+  if (this->bit_writer_.Overflowed()) return kDeflateError;
+  return this->bit_writer_.GetSize();
+}
+
+/**
+ * Compress a stream
+ *
+ * @param in pointer to start of the input
+ * @param in_size size of the input, in bytes
+ * @param out pointer to start of output buffer
+ * @param out_size_max maximum size of output buffer, in bytes;
+ * CompressBound() is always enough
+ * @param framing kNone for a raw deflate stream, kZLIB for a zlib stream
+ * with an Adler-32 trailer, kGZIP for a gzip member with a CRC32 trailer
+ *
+ * @return compressed size, or kDeflateError if the output buffer is too
+ * small
+ */
+size_t Compressor::Compress(const void* in, size_t in_size,
+                            unsigned char* out, size_t out_size_max,
+                            ChecksumType framing) {
+  this->in_ = (const unsigned char*)in;
+  this->in_size_ = in_size;
+  this->bit_writer_.Init(out, out_size_max);
+
+  switch (framing) {
+    case ChecksumType::kGZIP: {
+      /* no name nor time stamp, and the OS is unknown */
+      const unsigned char header[10] = {
+          0x1f, 0x8b, 0x08, 0, 0, 0, 0, 0, GetGzipXfl(this->level_), 0xff};
+      this->bit_writer_.PutBytes(header, sizeof(header));
+      break;
+    }
+    case ChecksumType::kZLIB: {
+      unsigned int header = MakeZlibHeader(this->level_);
+      const unsigned char bytes[2] = {(unsigned char)(header >> 8),
+                                      (unsigned char)header};
+      this->bit_writer_.PutBytes(bytes, sizeof(bytes));
+      break;
+    }
+    default:
+      break;
+  }
+
+  this->DeflateStream(true);
+
+  switch (framing) {
+    case ChecksumType::kGZIP: {
+      unsigned int check_sum =
+          Crc32Checksum::Update(Crc32Checksum::Init(), this->in_, in_size);
+      const unsigned char trailer[8] = {
+          (unsigned char)check_sum,         (unsigned char)(check_sum >> 8),
+          (unsigned char)(check_sum >> 16), (unsigned char)(check_sum >> 24),
+          (unsigned char)in_size,           (unsigned char)(in_size >> 8),
+          (unsigned char)(in_size >> 16),   (unsigned char)(in_size >> 24)};
+      this->bit_writer_.PutBytes(trailer, sizeof(trailer));
+      break;
+    }
+    case ChecksumType::kZLIB: {
+      unsigned int check_sum =
+          Adler32Checksum::Update(Adler32Checksum::Init(), this->in_, in_size);
+      const unsigned char trailer[4] = {
+          (unsigned char)(check_sum >> 24), (unsigned char)(check_sum >> 16),
+          (unsigned char)(check_sum >> 8), (unsigned char)check_sum};
+      this->bit_writer_.PutBytes(trailer, sizeof(trailer));
+      break;
+    }
+    default:
+      break;
+  }
+
+  this->in_ = nullptr;
+  this->in_size_ = 0;
+  if (this->bit_writer_.Overflowed()) return kDeflateError;
+  return this->bit_writer_.GetSize();
+}
+
+/**
+ * Compress a stream into a vector
+ *
+ * @param in pointer to start of the input
+ * @param in_size size of the input, in bytes
+ * @param out receives the compressed stream
+ * @param framing kNone, kZLIB or kGZIP
+ *
+ * @return compressed size
+ */
+size_t Compressor::Compress(const void* in, size_t in_size,
+                            std::vector<unsigned char>* out,
+                            ChecksumType framing) {
+  out->resize(CompressBound(in_size));
+  size_t size = this->Compress(in, in_size, out->data(), out->size(), framing);
+  out->resize((size == kDeflateError) ? 0 : size);
+  return size;
+}
+
+#endif /* !_COMPRESSOR_H */
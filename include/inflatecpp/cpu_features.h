@@ -0,0 +1,74 @@
+#ifndef _CPU_FEATURES_H
+#define _CPU_FEATURES_H
+
+/*-- CPU feature detection for the runtime-dispatched kernels --*/
+
+/**
+ * Kernels for optional instruction set extensions are compiled with
+ * function-level target attributes, so the rest of the library keeps the
+ * baseline ISA and one binary runs on every host. Which of them are used is
+ * decided at runtime, see inflate_dispatch.h.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define INFLATECPP_X86_DISPATCH
+#include <cpuid.h>
+#include <immintrin.h>
+#endif /* x86 */
+
+#if defined(__aarch64__) && defined(__linux__) && defined(__GNUC__)
+#define INFLATECPP_ARM_DISPATCH
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif /* aarch64 */
+
+enum InflateCpuFeature : unsigned int {
+  kCpuSsse3 = 1 << 0,
+  kCpuSse41 = 1 << 1,
+  kCpuPclmul = 1 << 2,
+  kCpuAvx2 = 1 << 3,
+  kCpuBmi2 = 1 << 4,
+  kCpuArmCrc32 = 1 << 5,
+};
+constexpr unsigned int kCpuAllFeatures = ~0U;
+
+/**
+ * Detect the instruction set extensions of the host that kernel variants
+ * exist for
+ *
+ * @return InflateCpuFeature bits
+ */
+unsigned int DetectCpuFeatures() {
+  unsigned int features = 0;
+
+#ifdef INFLATECPP_X86_DISPATCH
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+  if (ecx & (1 << 9)) features |= kCpuSsse3;
+  if (ecx & (1 << 19)) features |= kCpuSse41;
+  if (ecx & (1 << 1)) features |= kCpuPclmul;
+
+  /* AVX2 also needs the OS to save the ymm registers */
+  bool ymm_enabled = false;
+  if ((ecx & (1 << 27)) && (ecx & (1 << 28))) {
+    unsigned int xcr0_low, xcr0_high;
+    __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    ymm_enabled = (xcr0_low & 6) == 6;
+  }
+
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    if (ymm_enabled && (ebx & (1 << 5))) features |= kCpuAvx2;
+    if (ebx & (1 << 8)) features |= kCpuBmi2;
+  }
+#endif /* INFLATECPP_X86_DISPATCH */
+
+#ifdef INFLATECPP_ARM_DISPATCH
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  if (hwcap & (1 << 7)) features |= kCpuArmCrc32; /* HWCAP_CRC32 */
+#endif /* INFLATECPP_ARM_DISPATCH */
+
+  return features;
+}
+
+#endif /* !_CPU_FEATURES_H */
@@ -20,8 +20,11 @@ as being the original software.
 #define _CRC_32_H
 
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 
+#include "cpu_features.h"
+
 constexpr auto kLittleEdian = 1234;
 constexpr auto kBigEdian = 4321;
 constexpr unsigned int kCrc32Lookup[4][256] = {
@@ -240,4 +243,156 @@ unsigned int crc32_4bytes(const void* data, unsigned int length,
   return ~crc;
 }
 
+/**
+ * Multiply two polynomials modulo the CRC32 polynomial, bit-reflected
+ */
+unsigned int crc32_multiply(unsigned int a, unsigned int b) {
+  unsigned int m = 1U << 31, product = 0;
+
+  for (;;) {
+    if (a & m) {
+      product ^= b;
+      if (!(a & (m - 1))) break;
+    }
+    m >>= 1;
+    b = (b & 1) ? ((b >> 1) ^ 0xEDB88320) : (b >> 1);
+  }
+  return product;
+}
+
+/**
+ * CRC32 of two runs of bytes, one after the other, from the CRC32 of each,
+ * as zlib's crc32_combine() does: the first CRC32 is shifted over the
+ * second run by multiplying it by x^(8 * len2)
+ *
+ * @param crc1 CRC32 of the first run
+ * @param crc2 CRC32 of the second run
+ * @param len2 length of the second run, in bytes
+ *
+ * @return CRC32 of both runs
+ */
+unsigned int crc32_combine(unsigned int crc1, unsigned int crc2,
+                           unsigned long long len2) {
+  /* x^(2^k) for k = 3 onwards, squared as needed */
+  unsigned int power = 1U << 30;
+  for (int k = 0; k < 3; k++) power = crc32_multiply(power, power);
+
+  unsigned int shift = 1U << 31;
+  while (len2) {
+    if (len2 & 1) shift = crc32_multiply(power, shift);
+    power = crc32_multiply(power, power);
+    len2 >>= 1;
+  }
+  return crc32_multiply(shift, crc1) ^ crc2;
+}
+
+#ifdef INFLATECPP_X86_DISPATCH
+/**
+ * CRC32 by carry-less multiplication folding, after Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction". Folds
+ * four 128-bit lanes at a time and leaves the tail to crc32_4bytes().
+ */
+__attribute__((target("pclmul,sse4.1"))) unsigned int crc32_pclmul(
+    const void* data, unsigned int length, unsigned int previousCrc32) {
+  const unsigned char* current = (const unsigned char*)data;
+
+  if (length < 64) return crc32_4bytes(data, length, previousCrc32);
+
+  /* bit-reflected folding constants and Barrett reduction of 0xEDB88320 */
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  unsigned int fold_length = length & ~15U;
+  __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128((const __m128i*)(current + 0x00));
+  x2 = _mm_loadu_si128((const __m128i*)(current + 0x10));
+  x3 = _mm_loadu_si128((const __m128i*)(current + 0x20));
+  x4 = _mm_loadu_si128((const __m128i*)(current + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(~previousCrc32));
+  current += 64;
+  fold_length -= 64;
+
+  while (fold_length >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128((const __m128i*)(current + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                       _mm_loadu_si128((const __m128i*)(current + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                       _mm_loadu_si128((const __m128i*)(current + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                       _mm_loadu_si128((const __m128i*)(current + 0x30)));
+    current += 64;
+    fold_length -= 64;
+  }
+
+  /* fold the four lanes into one */
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  while (fold_length >= 16) {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128((const __m128i*)current));
+    current += 16;
+    fold_length -= 16;
+  }
+
+  /* 128 to 64 bits, then Barrett reduction to 32 bits */
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  unsigned int crc = ~(unsigned int)_mm_extract_epi32(x1, 1);
+  return crc32_4bytes(current, length & 15, crc);
+}
+#endif /* INFLATECPP_X86_DISPATCH */
+
+#ifdef INFLATECPP_ARM_DISPATCH
+/** CRC32 with the ARMv8 CRC32 instructions, 8 bytes at a time */
+__attribute__((target("+crc"))) unsigned int crc32_armv8(
+    const void* data, unsigned int length, unsigned int previousCrc32) {
+  const unsigned char* current = (const unsigned char*)data;
+  unsigned int crc = ~previousCrc32;
+
+  while (length >= 8) {
+    unsigned long long word;
+    std::memcpy(&word, current, 8);
+    crc = __crc32d(crc, word);
+    current += 8;
+    length -= 8;
+  }
+  while (length-- != 0) crc = __crc32b(crc, *current++);
+
+  return ~crc;
+}
+#endif /* INFLATECPP_ARM_DISPATCH */
+
 #endif /* !_CRC_32_H */
\ No newline at end of file
@@ -13,11 +13,17 @@
 #include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "adler32.h"
 #include "bit_reader.h"
 #include "crc32.h"
 #include "huffman_decoder.h"
+#include "inflate_dispatch.h"
+#include "inflate_policies.h"
+#include "inflate_stats.h"
 
 #define MATCHLEN_PAIR(__base, __dispbits) \
   ((__base) | ((__dispbits) << 16) | 0x8000)
@@ -30,9 +36,13 @@ constexpr auto kEODMarkerSym = 256;
 constexpr auto kMatchLenSymStart = 257;
 constexpr auto kMatchLenSyms = 29;
 constexpr auto kOffsetSyms = 32;
+constexpr auto kOffsetCodes = 30;
 constexpr auto kMinMatchSize = 3;
+constexpr auto kMaxMatchSize = 258;
+constexpr auto kWindowSize = 32768;
 
-constexpr unsigned int kMatchLenCode[kMatchLenSyms] = {
+/* padded to a power of two with invalid lengths, for the trusted loop */
+constexpr unsigned int kMatchLenCode[32] = {
     MATCHLEN_PAIR(kMinMatchSize + 0, 0),
     MATCHLEN_PAIR(kMinMatchSize + 1, 0),
     MATCHLEN_PAIR(kMinMatchSize + 2, 0),
@@ -62,6 +72,9 @@ constexpr unsigned int kMatchLenCode[kMatchLenSyms] = {
     MATCHLEN_PAIR(kMinMatchSize + 192, 5),
     MATCHLEN_PAIR(kMinMatchSize + 224, 5),
     MATCHLEN_PAIR(kMinMatchSize + 255, 0),
+    MATCHLEN_PAIR(0x7fff, 0),
+    MATCHLEN_PAIR(0x7fff, 0),
+    MATCHLEN_PAIR(0x7fff, 0),
 };
 
 constexpr unsigned int kOffsetCode[kOffsetSyms] = {
@@ -75,26 +88,301 @@ constexpr unsigned int kOffsetCode[kOffsetSyms] = {
     OFFSET_PAIR(1537, 9),   OFFSET_PAIR(2049, 10),  OFFSET_PAIR(3073, 10),
     OFFSET_PAIR(4097, 11),  OFFSET_PAIR(6145, 11),  OFFSET_PAIR(8193, 12),
     OFFSET_PAIR(12289, 12), OFFSET_PAIR(16385, 13), OFFSET_PAIR(24577, 13),
+    OFFSET_PAIR(0x7fff, 0), OFFSET_PAIR(0x7fff, 0),
 };
 
+/*-- decoder tables of Huffman-coded blocks, and their cache --*/
+
+typedef HuffmanDecoder<kCodeLenFastBits, kCodeLenSyms> CodeLenDecoder;
+typedef HuffmanDecoder<kLiteralFastBits, kLiteralSyms> LiteralDecoder;
+typedef HuffmanDecoder<kOffsetFastBits, kOffsetSyms> OffsetDecoder;
+
+/**
+ * Both decoders of a block, side by side. The decoders return raw symbols;
+ * the symbol loop maps lengths and distances through kMatchLenCode and
+ * kOffsetCode, which stay in cache next to them.
+ */
+struct alignas(64) HuffmanBlockTables {
+  LiteralDecoder literals_decoder;
+  OffsetDecoder offset_decoder;
+};
+
+/**
+ * Build the decoder tables of a block from its code lengths
+ *
+ * @param tables receives the tables
+ * @param code_length literal/length code lengths, then offset code lengths
+ * @param literal_syms number of literal/length code lengths
+ * @param offset_syms number of offset code lengths
+ *
+ * @return 0 for success, -1 for failure
+ */
+int BuildBlockTables(HuffmanBlockTables* tables,
+                     const unsigned char* code_length,
+                     unsigned int literal_syms, unsigned int offset_syms) {
+  if (tables->literals_decoder.PrepareTable(literal_syms, code_length) < 0)
+    return -1;
+  if (tables->offset_decoder.PrepareTable(offset_syms,
+                                          code_length + literal_syms) < 0)
+    return -1;
+
+  if (tables->literals_decoder.FinalizeTable() < 0) return -1;
+  if (tables->offset_decoder.FinalizeTable() < 0) return -1;
+
+  return 0;
+}
+
+constexpr auto kHuffmanTableCacheBits = 3;
+
+struct HuffmanTableCacheEntry {
+  bool built;
+  unsigned long long hash;
+  unsigned int literal_syms;
+  unsigned int offset_syms;
+  unsigned char code_length[kLiteralSyms + kOffsetSyms];
+  HuffmanBlockTables tables;
+};
+
+/**
+ * Small content-addressed cache of block decoder tables, keyed by the code
+ * lengths they are built from. Encoders tend to repeat the same tables from
+ * block to block and from message to message, and the fixed Huffman tables
+ * are the same for every block, so a hit skips the whole table build.
+ */
+class HuffmanTableCache {
+ public:
+  HuffmanTableCache();
+  ~HuffmanTableCache() = default;
+
+  HuffmanTableCacheEntry* Find(const unsigned char*, unsigned int,
+                               unsigned int);
+
+ private:
+  HuffmanTableCacheEntry entries_[1 << kHuffmanTableCacheBits];
+};
+
+HuffmanTableCache::HuffmanTableCache() {
+  for (auto& entry : this->entries_) entry.built = false;
+}
+
+/**
+ * Find the entry for a set of code lengths. On a miss, the entry that the
+ * code lengths map to is taken over and returned with built set to false;
+ * the caller builds its tables, then sets built.
+ *
+ * @param code_length literal/length code lengths, then offset code lengths
+ * @param literal_syms number of literal/length code lengths
+ * @param offset_syms number of offset code lengths
+ *
+ * @return cache entry
+ */
+HuffmanTableCacheEntry* HuffmanTableCache::Find(
+    const unsigned char* code_length, unsigned int literal_syms,
+    unsigned int offset_syms) {
+  const unsigned int size = literal_syms + offset_syms;
+  unsigned long long hash = size;
+  unsigned int i = 0;
+
+  for (; (i + 8) <= size; i += 8) {
+    unsigned long long word;
+    std::memcpy(&word, code_length + i, 8);
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+  }
+  for (; i < size; i++) hash = (hash ^ code_length[i]) * 0x100000001b3ULL;
+  hash ^= literal_syms << 8;
+
+  HuffmanTableCacheEntry* entry =
+      &this->entries_[hash >> (64 - kHuffmanTableCacheBits)];
+
+  if (entry->built && entry->hash == hash &&
+      entry->literal_syms == literal_syms &&
+      entry->offset_syms == offset_syms &&
+      !std::memcmp(entry->code_length, code_length, size))
+    return entry;
+
+  entry->built = false;
+  entry->hash = hash;
+  entry->literal_syms = literal_syms;
+  entry->offset_syms = offset_syms;
+  std::memcpy(entry->code_length, code_length, size);
+  return entry;
+}
+
+/**
+ * A run of decompressed bytes, either in the output buffer or, for stored
+ * blocks, directly in the compressed input
+ */
+struct InflateSegment {
+  const unsigned char* data;
+  size_t size;
+};
+
+/** Preset dictionary, as far as matches can reach into it */
+struct InflateDictionary {
+  const unsigned char* data;
+  unsigned int size;
+};
+
+/** Position between two blocks of a stream decoded through a rolling
+ * window */
+struct InflateBlockBoundary {
+  /* position of the next block, in bits from the start of the deflate data */
+  size_t in_bit_offset;
+  /* bytes decompressed by this call so far */
+  size_t out_offset;
+  /* up to kWindowSize bytes before out_offset, the history of the next
+   * block; only valid during the notification */
+  const unsigned char* history;
+  size_t history_size;
+};
+
+/**
+ * Receives the decompressed data of FeedStreaming() and ResumeStreaming()
+ * in order, in chunks of up to the rolling window size, and is notified at
+ * every block boundary with all the data before it delivered
+ */
+class InflateStreamObserver {
+ public:
+  virtual ~InflateStreamObserver() = default;
+
+  virtual void OnData(const unsigned char*, size_t) = 0;
+  /** Return false to stop decoding at this boundary */
+  virtual bool OnBlockBoundary(const InflateBlockBoundary&) { return true; }
+};
+
+/** Where ResumeStreaming() can resume decoding a stream */
+struct InflateCheckpoint {
+  size_t in_bit_offset;
+  /* bytes decompressed before the checkpoint */
+  size_t out_offset;
+  /* history of the next block */
+  std::vector<unsigned char> window;
+};
+
+/**
+ * Capture a checkpoint at a block boundary
+ *
+ * @param boundary block boundary, during its notification
+ * @param out_offset bytes decompressed before it, in the whole stream
+ *
+ * @return checkpoint
+ */
+InflateCheckpoint MakeInflateCheckpoint(const InflateBlockBoundary& boundary,
+                                        size_t out_offset) {
+  return InflateCheckpoint{
+      boundary.in_bit_offset, out_offset,
+      std::vector<unsigned char>(boundary.history,
+                                 boundary.history + boundary.history_size)};
+}
+
+enum class InflateStatus {
+  kOk = 0,
+  /* malformed or truncated stream, or an output buffer too small for it */
+  kDataError = 1,
+  /* zlib stream with a preset dictionary that was not added */
+  kNeedDictionary = 2,
+  /* the stream decoded, but its Adler-32/CRC32 trailer does not match */
+  kChecksumMismatch = 3,
+};
+
+/** Outcome of a decode; size is only meaningful when status is kOk */
+struct InflateResult {
+  InflateStatus status;
+  size_t size;
+
+  bool Ok() const { return this->status == InflateStatus::kOk; };
+};
+
+/* Decoders return sizes, or one of these. No stream decodes to that many
+ * bytes, as they do not fit in the address space. */
+constexpr size_t kInflateError = (size_t)-1;
+constexpr size_t kInflateBadChecksum = (size_t)-2;
+
+InflateResult MakeInflateResult(size_t size) {
+  if (size == kInflateError) return {InflateStatus::kDataError, 0};
+  if (size == kInflateBadChecksum) return {InflateStatus::kChecksumMismatch, 0};
+  return {InflateStatus::kOk, size};
+}
+
 class Decompressor {
  public:
   Decompressor(){};
   ~Decompressor() = default;
 
-  unsigned int Feed(const void*, unsigned int, unsigned char*, unsigned int,
-                    bool);
+  InflateResult Feed(const void*, size_t, unsigned char*, size_t, bool);
+  InflateResult FeedTrusted(const void*, size_t, unsigned char*, size_t);
+  InflateResult FeedSegments(const void*, size_t, unsigned char*, size_t,
+                             std::vector<InflateSegment>*, bool);
+  InflateResult Verify(const void*, size_t);
+  InflateResult FeedRange(const void*, size_t, size_t, unsigned char*, size_t,
+                          bool);
+  InflateResult FeedRaw(const void*, size_t, unsigned char*, size_t);
+  InflateResult FeedRawChunk(const void*, size_t, unsigned char*, size_t);
+  InflateResult FeedStreaming(const void*, size_t, InflateStreamObserver*,
+                              bool);
+  InflateResult ResumeStreaming(const void*, size_t, const InflateCheckpoint&,
+                                InflateStreamObserver*);
+
+  unsigned int AddDictionary(const void*, size_t);
+
+  /** Counters of the last Feed() call; all zero unless built with
+   * INFLATECPP_ENABLE_STATS */
+  const InflateStats& GetStats() const { return this->stats_; };
+
+#ifdef INFLATECPP_ENABLE_STATS
+  void SetPhaseObserver(InflatePhaseObserver* observer) {
+    this->observer_ = observer;
+  };
+#endif /* INFLATECPP_ENABLE_STATS */
+
+ private:
+  InflateStats stats_ = {};
+#ifdef INFLATECPP_ENABLE_STATS
+  InflatePhaseObserver* observer_ = nullptr;
+#endif /* INFLATECPP_ENABLE_STATS */
+  /* rolling window of Verify() and FeedRange(), allocated on first use */
+  std::unique_ptr<unsigned char[]> window_buffer_;
+  /* tails of the preset dictionaries, by Adler-32 DICTID */
+  std::unordered_map<unsigned int, std::vector<unsigned char>> dictionaries_;
+  /* decoder tables, shared by the streams of this Decompressor */
+  std::unique_ptr<HuffmanTableCache> table_cache_;
+
+  HuffmanTableCache* GetTableCache() {
+    if (!this->table_cache_) this->table_cache_.reset(new HuffmanTableCache);
+    return this->table_cache_.get();
+  };
+
+  void BeginStream(BitReader*);
+  InflateStatus ReadStreamHeader(const void*, size_t, BitReader*,
+                                 ChecksumType*, InflateDictionary*);
+  template <class BoundsCheck>
+  InflateResult Inflate(const void*, size_t, unsigned char*, size_t, bool);
+  InflateResult InflateRange(const void*, size_t, size_t, unsigned char*,
+                             size_t, size_t*, bool,
+                             InflateStreamObserver* = nullptr);
 };
 
-unsigned int CopyStored(BitReader* bit_reader, unsigned char* out,
-                        unsigned int out_offset, unsigned int block_size_max) {
+/**
+ * Read the header of a stored block and locate its data in the input
+ *
+ * @param bit_reader bit reader context, positioned after the block header;
+ * advanced past the stored data
+ * @param block_size_max maximum size of the block, in bytes
+ * @param stored_data receives a pointer to the stored data
+ *
+ * @return size of the stored data, or -1 in case of an error
+ */
+template <class Instrumentation = DefaultInstrumentation>
+size_t ReferenceStored(BitReader* bit_reader, size_t block_size_max,
+                       const unsigned char** stored_data) {
   if (bit_reader->ByteAllign() < 0) return -1;
 
   if ((bit_reader->GetInBlock() + 4) > bit_reader->GetInBlockEnd()) return -1;
 
   unsigned short stored_length =
       ((unsigned short)bit_reader->GetInBlock()[0]) |
-      (((unsigned short)bit_reader->GetInBlock()[0]) << 8);
+      (((unsigned short)bit_reader->GetInBlock()[1]) << 8);
   bit_reader->ModifyInBlock(2);
 
   unsigned short neg_stored_length =
@@ -106,32 +394,177 @@ unsigned int CopyStored(BitReader* bit_reader, unsigned char* out,
 
   if (stored_length > block_size_max) return -1;
 
-  std::memcpy(out + out_offset, bit_reader->GetInBlock(), stored_length);
+  if ((bit_reader->GetInBlock() + stored_length) > bit_reader->GetInBlockEnd())
+    return -1;
+
+  Instrumentation::Count(bit_reader, &InflateStats::stored_bytes,
+                         stored_length);
+
+  *stored_data = bit_reader->GetInBlock();
   bit_reader->ModifyInBlock(stored_length);
 
-  return (unsigned int)stored_length;
+  return (size_t)stored_length;
+}
+
+template <class BoundsCheck = ValidatedInput,
+          class Instrumentation = DefaultInstrumentation>
+size_t CopyStored(BitReader* bit_reader, unsigned char* out, size_t out_offset,
+                  size_t block_size_max) {
+  const unsigned char* stored_data;
+  size_t stored_length = ReferenceStored<Instrumentation>(
+      bit_reader, block_size_max, &stored_data);
+  if (stored_length == -1) return -1;
+
+  Instrumentation::PhaseBegin(bit_reader, InflatePhase::kSymbolLoop);
+  std::memcpy(out + out_offset, stored_data, stored_length);
+  Instrumentation::PhaseEnd(bit_reader, InflatePhase::kSymbolLoop);
+
+  return stored_length;
+}
+
+/* matches reaching further back than this are likely to miss L1 */
+constexpr auto kPrefetchMatchOffset = 4096;
+
+/**
+ * Prefetch the source of a far match and the output line after it, as soon
+ * as its distance is known, so that the misses overlap the bounds checks
+ * and the start of the copy instead of stalling it
+ *
+ * @param current_out current output position
+ * @param match_offset distance back to the start of the match, in bytes
+ * @param match_length match length, in bytes
+ */
+void PrefetchMatch(const unsigned char* current_out, unsigned int match_offset,
+                   unsigned int match_length) {
+#ifdef __GNUC__
+  if (match_offset >= kPrefetchMatchOffset) {
+    __builtin_prefetch(current_out - match_offset);
+    __builtin_prefetch(current_out + match_length, 1);
+  }
+#endif /* __GNUC__ */
+}
+
+/**
+ * Copy a match from the already decompressed data
+ *
+ * @param current_out current output position
+ * @param match_offset distance back to the start of the match, in bytes
+ * @param match_length match length, in bytes
+ * @param out_fast_end end of the area where 16-byte copies may overrun
+ *
+ * @return output position after the match
+ */
+unsigned char* CopyMatch(unsigned char* current_out, unsigned int match_offset,
+                         unsigned int match_length,
+                         const unsigned char* out_fast_end) {
+  const unsigned char* src = current_out - match_offset;
+
+  if (match_offset >= 16 && (current_out + match_length) <= out_fast_end) {
+    unsigned char* copy_dst = current_out;
+    const unsigned char* copy_end_dst = current_out + match_length;
+
+    do {
+      std::memcpy(copy_dst, src, 16);
+      src += 16;
+      copy_dst += 16;
+    } while (copy_dst < copy_end_dst);
+
+    return current_out + match_length;
+  }
+
+  while (match_length--) {
+    *current_out++ = *src++;
+  }
+  return current_out;
+}
+
+/**
+ * Copy a match that starts before the decompressed data, in the preset
+ * dictionary
+ *
+ * @param current_out current output position
+ * @param out pointer to start of the decompressed data
+ * @param match_offset distance back to the start of the match, in bytes
+ * @param match_length match length, in bytes
+ * @param dictionary preset dictionary, if any
+ *
+ * @return output position after the match, or nullptr if the match starts
+ * before the dictionary too
+ */
+unsigned char* CopyDictionaryMatch(unsigned char* current_out,
+                                   const unsigned char* out,
+                                   unsigned int match_offset,
+                                   unsigned int match_length,
+                                   const InflateDictionary* dictionary) {
+  unsigned int dictionary_offset =
+      match_offset - (unsigned int)(current_out - out);
+  if (!dictionary || dictionary_offset > dictionary->size) return nullptr;
+
+  unsigned int length =
+      match_length < dictionary_offset ? match_length : dictionary_offset;
+  std::memcpy(current_out,
+              dictionary->data + dictionary->size - dictionary_offset, length);
+  current_out += length;
+  match_length -= length;
+
+  /* the rest of the match may overlap itself */
+  const unsigned char* src = out;
+  while (match_length--) {
+    *current_out++ = *src++;
+  }
+  return current_out;
 }
 
-unsigned int DecompressBlock(BitReader* bit_reader, int dynamic_block,
-                             unsigned char* out, unsigned int out_offset,
-                             unsigned int block_size_max) {
-  HuffmanDecoder literals_decoder;
-  HuffmanDecoder offset_decoder;
-  unsigned int literals_rev_sym_table[kLiteralSyms * 2];
-  unsigned int offset_rev_sym_table[kLiteralSyms * 2];
+/**
+ * Decompress one Huffman-coded block
+ *
+ * @tparam Block FixedHuffmanBlock or DynamicHuffmanBlock
+ * @tparam BoundsCheck input and output validation level
+ * @tparam Instrumentation NoInstrumentation or CountingInstrumentation
+ * @tparam Output BufferOutput or RollingWindow
+ *
+ * @param bit_reader bit reader context, positioned after the block header
+ * @param out pointer to start of decompression buffer
+ * @param out_offset offset of the block in the decompression buffer
+ * @param block_size_max maximum size of the block, in bytes; with a rolling
+ * window, the space left before the window has to slide
+ * @param dictionary preset dictionary that precedes out, if any
+ * @param table_cache cache of decoder tables, if any
+ * @param output rolling window, if any
+ *
+ * @return number of bytes decompressed, or -1 in case of an error
+ */
+template <class Block, class BoundsCheck = ValidatedInput,
+          class Instrumentation = DefaultInstrumentation,
+          class Output = BufferOutput>
+size_t DecompressBlock(BitReader* bit_reader, unsigned char* out,
+                       size_t out_offset, size_t block_size_max,
+                       const InflateDictionary* dictionary = nullptr,
+                       HuffmanTableCache* table_cache = nullptr,
+                       Output* output = nullptr) {
+  static_assert(!(BoundsCheck::kTrusted && Output::kWindowed),
+                "a rolling window is only decoded with validated input");
+
+  HuffmanBlockTables block_tables;
+  HuffmanBlockTables* tables = &block_tables;
+  unsigned char code_length[kLiteralSyms + kOffsetSyms];
+  unsigned int literal_syms;
+  unsigned int offset_syms;
   int i;
 
-  if (dynamic_block) {
-    HuffmanDecoder tables_decoder;
-    unsigned char code_length[kLiteralSyms + kOffsetSyms];
-    unsigned int tables_rev_sym_table[kCodeLenSyms * 2];
+  unsigned long long table_start = Instrumentation::Now();
+
+  if constexpr (Block::kDynamic) {
+    CodeLenDecoder tables_decoder;
 
-    unsigned int literal_syms = bit_reader->GetBits(5);
+    Instrumentation::PhaseBegin(bit_reader, InflatePhase::kHeader);
+
+    literal_syms = bit_reader->GetBits(5);
     if (literal_syms == -1) return -1;
     literal_syms += 257;
     if (literal_syms > kLiteralSyms) return -1;
 
-    unsigned int offset_syms = bit_reader->GetBits(5);
+    offset_syms = bit_reader->GetBits(5);
     if (offset_syms == -1) return -1;
     offset_syms += 1;
     if (offset_syms > kOffsetSyms) return -1;
@@ -141,127 +574,753 @@ unsigned int DecompressBlock(BitReader* bit_reader, int dynamic_block,
     code_len_syms += 4;
     if (code_len_syms > kCodeLenSyms) return -1;
 
-    if (HuffmanDecoder::ReadRawLengths(kCodeLenBits, code_len_syms,
+    if (CodeLenDecoder::ReadRawLengths(kCodeLenBits, code_len_syms,
                                        kCodeLenSyms, code_length,
                                        bit_reader) < 0)
       return -1;
-    if (tables_decoder.PrepareTable(tables_rev_sym_table, kCodeLenSyms,
-                                    kCodeLenSyms, code_length) < 0)
-      return -1;
-    if (tables_decoder.FinalizeTable(tables_rev_sym_table) < 0) return -1;
 
-    if (tables_decoder.ReadLength(
-            tables_rev_sym_table, literal_syms + offset_syms,
-            kLiteralSyms + kOffsetSyms, code_length, bit_reader) < 0)
-      return -1;
-    if (literals_decoder.PrepareTable(literals_rev_sym_table, literal_syms,
-                                      kLiteralSyms, code_length) < 0)
-      return -1;
-    if (offset_decoder.PrepareTable(offset_rev_sym_table, offset_syms,
-                                    kOffsetSyms,
-                                    code_length + literal_syms) < 0)
-      return -1;
-  } else {
-    unsigned char fixed_literal_code_len[kLiteralSyms];
-    unsigned char fixed_offset_code_len[kOffsetSyms];
+    Instrumentation::PhaseEnd(bit_reader, InflatePhase::kHeader);
+    Instrumentation::PhaseBegin(bit_reader, InflatePhase::kTableBuild);
 
-    for (i = 0; i < 144; i++) fixed_literal_code_len[i] = 8;
-    for (; i < 256; i++) fixed_literal_code_len[i] = 9;
-    for (; i < 280; i++) fixed_literal_code_len[i] = 7;
-    for (; i < kLiteralSyms; i++) fixed_literal_code_len[i] = 8;
+    if (tables_decoder.PrepareTable(kCodeLenSyms, code_length) < 0) return -1;
+    if (tables_decoder.FinalizeTable() < 0) return -1;
 
-    for (i = 0; i < kOffsetSyms; i++) fixed_offset_code_len[i] = 5;
+    Instrumentation::PhaseEnd(bit_reader, InflatePhase::kTableBuild);
+    Instrumentation::PhaseBegin(bit_reader, InflatePhase::kHeader);
 
-    if (literals_decoder.PrepareTable(literals_rev_sym_table, kLiteralSyms,
-                                      kLiteralSyms, fixed_literal_code_len) < 0)
-      return -1;
-    if (offset_decoder.PrepareTable(offset_rev_sym_table, kOffsetSyms,
-                                    kOffsetSyms, fixed_offset_code_len) < 0)
+    if (tables_decoder.ReadLength(literal_syms + offset_syms,
+                                  kLiteralSyms + kOffsetSyms, code_length,
+                                  bit_reader) < 0)
       return -1;
+
+    Instrumentation::PhaseEnd(bit_reader, InflatePhase::kHeader);
+  } else {
+    literal_syms = kLiteralSyms;
+    offset_syms = kOffsetSyms;
+
+    for (i = 0; i < 144; i++) code_length[i] = 8;
+    for (; i < 256; i++) code_length[i] = 9;
+    for (; i < 280; i++) code_length[i] = 7;
+    for (; i < kLiteralSyms; i++) code_length[i] = 8;
+
+    for (i = 0; i < kOffsetSyms; i++) code_length[kLiteralSyms + i] = 5;
   }
 
-  for (i = 0; i < kOffsetSyms; i++) {
-    unsigned int n = offset_rev_sym_table[i];
-    if (n < kOffsetSyms) {
-      offset_rev_sym_table[i] = kOffsetCode[n];
-    }
+  Instrumentation::PhaseBegin(bit_reader, InflatePhase::kTableBuild);
+
+  HuffmanTableCacheEntry* cache_entry = nullptr;
+  if (table_cache) {
+    cache_entry = table_cache->Find(code_length, literal_syms, offset_syms);
+    tables = &cache_entry->tables;
   }
 
-  for (i = 0; i < kLiteralSyms; i++) {
-    unsigned int n = literals_rev_sym_table[i];
-    if (n >= kMatchLenSymStart && n < kLiteralSyms) {
-      literals_rev_sym_table[i] = kMatchLenCode[n - kMatchLenSymStart];
+  if (cache_entry && cache_entry->built) {
+    Instrumentation::Count(bit_reader, &InflateStats::table_cache_hits, 1);
+  } else {
+    if (BuildBlockTables(tables, code_length, literal_syms, offset_syms) < 0)
+      return -1;
+    if (cache_entry) {
+      Instrumentation::Count(bit_reader, &InflateStats::table_cache_misses, 1);
+      cache_entry->built = true;
     }
   }
 
-  if (literals_decoder.FinalizeTable(literals_rev_sym_table) < 0) return -1;
-  if (offset_decoder.FinalizeTable(offset_rev_sym_table) < 0) return -1;
+  LiteralDecoder& literals_decoder = tables->literals_decoder;
+  OffsetDecoder& offset_decoder = tables->offset_decoder;
+
+  Instrumentation::PhaseEnd(bit_reader, InflatePhase::kTableBuild);
+  if constexpr (Block::kDynamic)
+    Instrumentation::Count(bit_reader, &InflateStats::dynamic_table_ns,
+                           Instrumentation::Now() - table_start);
 
   unsigned char* current_out = out + out_offset;
   const unsigned char* out_end = current_out + block_size_max;
   const unsigned char* out_fast_end = out_end - 15;
+  /* bytes that went out of the buffer when the rolling window slid */
+  size_t slid_size = 0;
+
+  Instrumentation::PhaseBegin(bit_reader, InflatePhase::kSymbolLoop);
+
+  if constexpr (BoundsCheck::kTrusted && kBitReaderRefill32) {
+    /* Any symbol fits before out_trusted_end, and two Refill32() calls per
+     * iteration always find their 4 bytes, so the only checks left are the
+     * match length, which also rejects invalid length codes, and the offset
+     * symbol. The validated loop below finishes the block once either margin
+     * runs out. */
+    const unsigned char* out_trusted_end =
+        block_size_max > kMaxMatchSize ? out_end - kMaxMatchSize : current_out;
+
+    while (current_out < out_trusted_end &&
+           (bit_reader->GetInBlock() + 8) <= bit_reader->GetInBlockEnd()) {
+      bit_reader->Refill32();
+
+      unsigned int literals_sym = literals_decoder.ReadValue<true>(bit_reader);
+      if (literals_sym < 256) {
+        Instrumentation::Count(bit_reader, &InflateStats::literals, 1);
+        *current_out++ = literals_sym;
+        continue;
+      }
+      if (literals_sym == kEODMarkerSym) {
+        Instrumentation::PhaseEnd(bit_reader, InflatePhase::kSymbolLoop);
+        return (size_t)(current_out - (out + out_offset));
+      }
+
+      /* invalid symbols, and -1, land on the padding of kMatchLenCode */
+      unsigned int literals_code_word =
+          kMatchLenCode[(literals_sym - kMatchLenSymStart) & 31];
+      unsigned int match_length =
+          bit_reader->GetBufferedBits((literals_code_word >> 16) & 15) +
+          (literals_code_word & 0x7fff);
+      if (match_length > kMaxMatchSize) return -1;
+
+      bit_reader->Refill32();
+
+      /* symbols 30 and 31, and -1, are invalid; a distance alone cannot
+       * tell, as the padding of kOffsetCode is in range once the window
+       * is full */
+      unsigned int offset_sym = offset_decoder.ReadValue<true>(bit_reader);
+      if (offset_sym >= kOffsetCodes) return -1;
+
+      unsigned int offset_code_word = kOffsetCode[offset_sym];
+      unsigned int match_offset =
+          bit_reader->GetBufferedBits((offset_code_word >> 16) & 15) +
+          (offset_code_word & 0x7fff);
+      PrefetchMatch(current_out, match_offset, match_length);
+
+      Instrumentation::Count(bit_reader, &InflateStats::matches, 1);
+      Instrumentation::Count(bit_reader, &InflateStats::match_bytes,
+                             match_length);
+
+      if ((current_out - match_offset) < out) {
+        current_out = CopyDictionaryMatch(current_out, out, match_offset,
+                                          match_length, dictionary);
+        if (!current_out) return -1;
+        continue;
+      }
+
+      Instrumentation::Count(
+          bit_reader, &InflateStats::short_offset_copies,
+          (match_offset < 16 || (current_out + match_length) > out_fast_end));
+
+      current_out =
+          CopyMatch(current_out, match_offset, match_length, out_fast_end);
+    }
+  }
 
   while (1) {
     bit_reader->Refill32();
 
-    unsigned int literals_code_word =
-        literals_decoder.ReadValue(literals_rev_sym_table, bit_reader);
-    if (literals_code_word < 256) {
+    unsigned int literals_sym = literals_decoder.ReadValue(bit_reader);
+    if (literals_sym < 256) {
+      Instrumentation::Count(bit_reader, &InflateStats::literals, 1);
+      if constexpr (Output::kWindowed) {
+        if (current_out >= out_end) {
+          unsigned char* window_out = output->Slide(current_out);
+          slid_size += (size_t)(current_out - window_out);
+          current_out = window_out;
+        }
+      }
       if (current_out < out_end)
-        *current_out++ = literals_code_word;
+        *current_out++ = literals_sym;
       else
         return -1;
     } else {
-      if (literals_code_word == kEODMarkerSym) break;
-      if (literals_code_word == -1) return -1;
+      if (literals_sym == kEODMarkerSym) break;
+      if (literals_sym >= kMatchLenSymStart + kMatchLenSyms) return -1;
 
+      unsigned int literals_code_word =
+          kMatchLenCode[literals_sym - kMatchLenSymStart];
       unsigned int match_length =
           bit_reader->GetBits((literals_code_word >> 16) & 15);
       if (match_length == -1) return -1;
 
       match_length += (literals_code_word & 0x7fff);
 
-      unsigned int offset_code_word =
-          offset_decoder.ReadValue(offset_rev_sym_table, bit_reader);
-      if (offset_code_word == -1) return -1;
+      unsigned int offset_sym = offset_decoder.ReadValue(bit_reader);
+      if (offset_sym >= kOffsetCodes) return -1;
+
+      unsigned int offset_code_word = kOffsetCode[offset_sym];
 
       unsigned int match_offset =
           bit_reader->GetBits((offset_code_word >> 16) & 15);
       if (match_offset == -1) return -1;
 
       match_offset += (offset_code_word & 0x7fff);
+      PrefetchMatch(current_out, match_offset, match_length);
 
-      const unsigned char* src = current_out - match_offset;
-      if (src >= out) {
-        if (match_offset >= 16 &&
-            (current_out + match_length) <= out_fast_end) {
-          const unsigned char* copy_src = src;
-          unsigned char* copy_dst = current_out;
-          const unsigned char* copy_end_dst = current_out + match_length;
-
-          do {
-            std::memcpy(copy_dst, copy_src, 16);
-            copy_src += 16;
-            copy_dst += 16;
-          } while (copy_dst < copy_end_dst);
-
-          current_out += match_length;
-        } else {
-          if ((current_out + match_length) > out_end) return -1;
-
-          while (match_length--) {
-            *current_out++ = *src++;
-          }
+      if constexpr (Output::kWindowed) {
+        if ((current_out + match_length) > out_end) {
+          unsigned char* window_out = output->Slide(current_out);
+          slid_size += (size_t)(current_out - window_out);
+          current_out = window_out;
         }
-      } else
+      }
+
+      if ((current_out + match_length) > out_end) return -1;
+
+      Instrumentation::Count(bit_reader, &InflateStats::matches, 1);
+      Instrumentation::Count(bit_reader, &InflateStats::match_bytes,
+                             match_length);
+
+      if ((current_out - match_offset) < out) {
+        current_out = CopyDictionaryMatch(current_out, out, match_offset,
+                                          match_length, dictionary);
+        if (!current_out) return -1;
+        continue;
+      }
+
+      Instrumentation::Count(
+          bit_reader, &InflateStats::short_offset_copies,
+          (match_offset < 16 || (current_out + match_length) > out_fast_end));
+
+      current_out =
+          CopyMatch(current_out, match_offset, match_length, out_fast_end);
+    }
+  }
+
+  Instrumentation::PhaseEnd(bit_reader, InflatePhase::kSymbolLoop);
+
+  return (size_t)(current_out - (out + out_offset)) + slid_size;
+}
+
+/**
+ * Decompress one Huffman-coded block, selecting the specialised decoder at
+ * runtime
+ *
+ * @param dynamic_block 0 for a fixed block, 1 for a dynamic block
+ *
+ * @return number of bytes decompressed, or -1 in case of an error
+ */
+size_t DecompressBlock(BitReader* bit_reader, int dynamic_block,
+                       unsigned char* out, size_t out_offset,
+                       size_t block_size_max) {
+  if (dynamic_block)
+    return DecompressBlock<DynamicHuffmanBlock>(bit_reader, out, out_offset,
+                                                block_size_max);
+  return DecompressBlock<FixedHuffmanBlock>(bit_reader, out, out_offset,
+                                            block_size_max);
+}
+
+/**
+ * Decompress all blocks of a deflate stream and verify its trailer
+ *
+ * @tparam Checksum NoChecksum, Crc32Checksum or Adler32Checksum
+ * @tparam BoundsCheck input and output validation level
+ * @tparam Instrumentation NoInstrumentation or CountingInstrumentation
+ *
+ * @param bit_reader bit reader context, positioned on the first block
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes
+ * @param dictionary preset dictionary, if any
+ * @param table_cache cache of decoder tables, if any
+ * @param until_flush also stop at a stored block that ends the input, the
+ * flush point that ends a chunk of a stream
+ *
+ * @return number of bytes decompressed, or -1 in case of an error
+ */
+template <class Checksum, class BoundsCheck = ValidatedInput,
+          class Instrumentation = DefaultInstrumentation>
+size_t InflateBlocks(BitReader* bit_reader, unsigned char* out,
+                     size_t out_size_max,
+                     const InflateDictionary* dictionary = nullptr,
+                     HuffmanTableCache* table_cache = nullptr,
+                     bool until_flush = false) {
+  unsigned int final_block;
+  bool flush_point = false;
+  size_t current_out_offset = 0;
+  unsigned int check_sum = Checksum::Init();
+
+  do {
+    size_t block_result;
+
+    final_block = bit_reader->GetBits(1);
+    unsigned int block_type = bit_reader->GetBits(2);
+
+    switch (block_type) {
+      case 0:
+        Instrumentation::Count(bit_reader, &InflateStats::stored_blocks, 1);
+        block_result = CopyStored<BoundsCheck, Instrumentation>(
+            bit_reader, out, current_out_offset,
+            out_size_max - current_out_offset);
+        /* stored blocks leave the reader byte-aligned, with nothing
+         * buffered */
+        flush_point = until_flush &&
+                      bit_reader->GetInBlock() == bit_reader->GetInBlockEnd();
+        break;
+
+      case 1:
+        Instrumentation::Count(bit_reader, &InflateStats::fixed_blocks, 1);
+        block_result =
+            DecompressBlock<FixedHuffmanBlock, BoundsCheck, Instrumentation>(
+                bit_reader, out, current_out_offset,
+                out_size_max - current_out_offset, dictionary, table_cache);
+        break;
+
+      case 2:
+        Instrumentation::Count(bit_reader, &InflateStats::dynamic_blocks, 1);
+        block_result =
+            DecompressBlock<DynamicHuffmanBlock, BoundsCheck, Instrumentation>(
+                bit_reader, out, current_out_offset,
+                out_size_max - current_out_offset, dictionary, table_cache);
+        break;
+
+      default:
         return -1;
     }
+
+    if (block_result == -1) return -1;
+
+    if constexpr (Checksum::kType != ChecksumType::kNone) {
+      Instrumentation::PhaseBegin(bit_reader, InflatePhase::kChecksum);
+      check_sum =
+          Checksum::Update(check_sum, out + current_out_offset, block_result);
+      Instrumentation::PhaseEnd(bit_reader, InflatePhase::kChecksum);
+    }
+
+    current_out_offset += block_result;
+  } while (!final_block && !flush_point);
+
+  bit_reader->ByteAllign();
+
+  if constexpr (Checksum::kType != ChecksumType::kNone) {
+    const unsigned char* current_compressed_data = bit_reader->GetInBlock();
+
+    Instrumentation::PhaseBegin(bit_reader, InflatePhase::kChecksum);
+
+    if ((current_compressed_data + 4) > bit_reader->GetInBlockEnd())
+      return -1;
+    if (Checksum::ReadStored(current_compressed_data) != check_sum)
+      return kInflateBadChecksum;
+    bit_reader->ModifyInBlock(4);
+
+    Instrumentation::PhaseEnd(bit_reader, InflatePhase::kChecksum);
   }
 
-  return (unsigned int)(current_out - (out + out_offset));
+  return current_out_offset;
 }
 
-enum ChecksumType { kNone = 0, kGZIP = 1, kZLIB = 2 };
+/**
+ * Decompress all blocks of a deflate stream into a list of segments, and
+ * verify its trailer. Stored blocks are referenced in the input instead of
+ * being copied; only Huffman-coded blocks are written to the output buffer.
+ *
+ * A Huffman-coded block may copy matches from up to kWindowSize bytes back,
+ * so the tail of the stored data that precedes it is copied to the output
+ * buffer first, right after the previous Huffman-coded data. The output
+ * buffer therefore never needs more than the decompressed size.
+ *
+ * @tparam Checksum NoChecksum, Crc32Checksum or Adler32Checksum
+ * @tparam Instrumentation NoInstrumentation or CountingInstrumentation
+ *
+ * @param bit_reader bit reader context, positioned on the first block
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes
+ * @param segments receives the decompressed data, in order
+ * @param dictionary preset dictionary, if any
+ * @param table_cache cache of decoder tables, if any
+ *
+ * @return number of bytes decompressed, or -1 in case of an error
+ */
+template <class Checksum, class Instrumentation = DefaultInstrumentation>
+size_t InflateSegments(BitReader* bit_reader, unsigned char* out,
+                       size_t out_size_max,
+                       std::vector<InflateSegment>* segments,
+                       const InflateDictionary* dictionary = nullptr,
+                       HuffmanTableCache* table_cache = nullptr) {
+  unsigned int final_block;
+  size_t total_size = 0;
+  size_t out_offset = 0;
+  /* out[history_offset, out_offset) is contiguous decompressed data, which
+   * is followed by the stored segments from first_stored_segment on */
+  size_t history_offset = 0;
+  size_t first_stored_segment = 0;
+  /* end of the last segment, if it is in out and may be extended */
+  const unsigned char* out_segment_end = nullptr;
+  unsigned int check_sum = Checksum::Init();
+
+  segments->clear();
+
+  do {
+    const unsigned char* block_data;
+    size_t block_result;
+
+    final_block = bit_reader->GetBits(1);
+    unsigned int block_type = bit_reader->GetBits(2);
+
+    if (block_type == 0) {
+      Instrumentation::Count(bit_reader, &InflateStats::stored_blocks, 1);
+      block_result = ReferenceStored<Instrumentation>(
+          bit_reader, kInflateBadChecksum - 1 - total_size, &block_data);
+      if (block_result == -1) return -1;
+
+      if (block_result) {
+        segments->push_back(InflateSegment{block_data, block_result});
+        out_segment_end = nullptr;
+      }
+    } else if (block_type == 1 || block_type == 2) {
+      if (first_stored_segment < segments->size()) {
+        size_t stored_size = 0;
+        for (size_t i = first_stored_segment; i < segments->size(); i++)
+          stored_size += (*segments)[i].size;
+
+        size_t skip = 0;
+        if (stored_size >= kWindowSize) {
+          skip = stored_size - kWindowSize;
+          history_offset = out_offset;
+        }
+        if ((stored_size - skip) > (out_size_max - out_offset)) return -1;
+
+        for (size_t i = first_stored_segment; i < segments->size(); i++) {
+          const InflateSegment& segment = (*segments)[i];
+          if (skip >= segment.size) {
+            skip -= segment.size;
+            continue;
+          }
+          std::memcpy(out + out_offset, segment.data + skip,
+                      segment.size - skip);
+          out_offset += segment.size - skip;
+          skip = 0;
+        }
+      }
+
+      unsigned char* block_out = out + out_offset;
+      /* the dictionary only precedes the history until a full window of
+       * stored data replaces it */
+      const InflateDictionary* block_dictionary =
+          history_offset ? nullptr : dictionary;
+
+      if (block_type == 1) {
+        Instrumentation::Count(bit_reader, &InflateStats::fixed_blocks, 1);
+        block_result =
+            DecompressBlock<FixedHuffmanBlock, ValidatedInput, Instrumentation>(
+                bit_reader, out + history_offset, out_offset - history_offset,
+                out_size_max - out_offset, block_dictionary, table_cache);
+      } else {
+        Instrumentation::Count(bit_reader, &InflateStats::dynamic_blocks, 1);
+        block_result =
+            DecompressBlock<DynamicHuffmanBlock, ValidatedInput,
+                            Instrumentation>(
+                bit_reader, out + history_offset, out_offset - history_offset,
+                out_size_max - out_offset, block_dictionary, table_cache);
+      }
+      if (block_result == -1) return -1;
+
+      if (block_result) {
+        if (block_out == out_segment_end)
+          segments->back().size += block_result;
+        else
+          segments->push_back(InflateSegment{block_out, block_result});
+        out_segment_end = block_out + block_result;
+      }
+
+      block_data = block_out;
+      out_offset += block_result;
+      first_stored_segment = segments->size();
+    } else {
+      return -1;
+    }
+
+    if constexpr (Checksum::kType != ChecksumType::kNone) {
+      Instrumentation::PhaseBegin(bit_reader, InflatePhase::kChecksum);
+      check_sum = Checksum::Update(check_sum, block_data, block_result);
+      Instrumentation::PhaseEnd(bit_reader, InflatePhase::kChecksum);
+    }
+
+    total_size += block_result;
+  } while (!final_block);
+
+  bit_reader->ByteAllign();
+
+  if constexpr (Checksum::kType != ChecksumType::kNone) {
+    const unsigned char* current_compressed_data = bit_reader->GetInBlock();
+
+    Instrumentation::PhaseBegin(bit_reader, InflatePhase::kChecksum);
+
+    if ((current_compressed_data + 4) > bit_reader->GetInBlockEnd())
+      return -1;
+    if (Checksum::ReadStored(current_compressed_data) != check_sum)
+      return kInflateBadChecksum;
+    bit_reader->ModifyInBlock(4);
+
+    Instrumentation::PhaseEnd(bit_reader, InflatePhase::kChecksum);
+  }
+
+  return total_size;
+}
+
+/*-- rolling window, for decoding without materialising the output --*/
+
+constexpr auto kRollingWindowChunk = 4 * kWindowSize;
+constexpr auto kRollingWindowSize = kWindowSize + kRollingWindowChunk;
+
+/**
+ * Output of DecompressBlock() that keeps only the last kWindowSize bytes as
+ * match history. Whenever the buffer fills up, the new bytes are added to
+ * the checksum, the ones in the requested range are copied to the caller,
+ * and the history slides back to the start of the buffer. The buffer stays
+ * cache-resident, whatever the size of the stream.
+ */
+template <class Checksum>
+class RollingWindow {
+ public:
+  static constexpr bool kWindowed = true;
+
+  RollingWindow(unsigned char*, size_t, unsigned char*, size_t);
+  ~RollingWindow() = default;
+
+  unsigned char* GetBuffer() { return this->buffer_; };
+  /** Offset of GetBuffer()[0] in the decompressed data */
+  size_t GetBase() { return this->base_; };
+  unsigned int GetCheckSum() { return this->check_sum_; };
+  size_t GetOutSize() { return this->out_size_; };
+  /** Size of the preset dictionary at the start of the window */
+  size_t GetPrimedSize() { return this->primed_size_; };
+  InflateStreamObserver* GetObserver() { return this->observer_; };
+  void SetObserver(InflateStreamObserver* observer) {
+    this->observer_ = observer;
+  };
+
+  void Prime(const InflateDictionary&);
+  unsigned char* Slide(unsigned char*);
+  unsigned char* Append(unsigned char*, const unsigned char*, size_t);
+  void Flush(unsigned char*);
+
+ private:
+  void Consume(const unsigned char*, size_t);
+
+  unsigned char* buffer_;
+  size_t base_;
+  /* offset of the first byte not consumed yet, in the decompressed data */
+  size_t consumed_;
+  unsigned int check_sum_;
+  unsigned char* out_;
+  size_t skip_size_;
+  size_t out_size_max_;
+  size_t out_size_;
+  size_t primed_size_;
+  InflateStreamObserver* observer_;
+};
+
+/**
+ * Initialize rolling window
+ *
+ * @param buffer window buffer, kRollingWindowSize bytes
+ * @param skip_size number of decompressed bytes to discard
+ * @param out pointer to start of the buffer receiving the bytes that follow
+ * @param out_size_max size of that buffer; the rest is discarded
+ */
+template <class Checksum>
+RollingWindow<Checksum>::RollingWindow(unsigned char* buffer, size_t skip_size,
+                                       unsigned char* out,
+                                       size_t out_size_max) {
+  this->buffer_ = buffer;
+  this->base_ = 0;
+  this->consumed_ = 0;
+  this->check_sum_ = Checksum::Init();
+  this->out_ = out;
+  this->skip_size_ = skip_size;
+  this->out_size_max_ = out_size_max;
+  this->out_size_ = 0;
+  this->primed_size_ = 0;
+  this->observer_ = nullptr;
+}
+
+/**
+ * Start the window with a preset dictionary, which is history for matches
+ * but not part of the decompressed data
+ *
+ * @param dictionary preset dictionary, no more than kWindowSize bytes
+ */
+template <class Checksum>
+void RollingWindow<Checksum>::Prime(const InflateDictionary& dictionary) {
+  if (dictionary.size)
+    std::memcpy(this->buffer_, dictionary.data, dictionary.size);
+  this->consumed_ = dictionary.size;
+  this->primed_size_ = dictionary.size;
+}
+
+/** Checksum decompressed bytes and copy the requested range out of them */
+template <class Checksum>
+void RollingWindow<Checksum>::Consume(const unsigned char* data, size_t size) {
+  unsigned long long start = this->consumed_;
+  unsigned long long end = start + size;
+  unsigned long long out_start =
+      (unsigned long long)this->primed_size_ + this->skip_size_;
+  unsigned long long out_end = out_start + this->out_size_max_;
+
+  this->check_sum_ = Checksum::Update(this->check_sum_, data, size);
+  if (this->observer_ && size) this->observer_->OnData(data, size);
+
+  if (start < out_start) start = out_start;
+  if (end > out_end) end = out_end;
+  if (start < end) {
+    std::memcpy(this->out_ + (start - out_start),
+                data + (start - this->consumed_), end - start);
+    this->out_size_ = (size_t)(end - out_start);
+  }
+
+  this->consumed_ += size;
+}
+
+/**
+ * Consume the bytes decompressed since the last call and move the history
+ * back to the start of the buffer
+ *
+ * @param current_out current output position
+ *
+ * @return new output position, with at least kRollingWindowChunk bytes
+ * left in the buffer
+ */
+template <class Checksum>
+unsigned char* RollingWindow<Checksum>::Slide(unsigned char* current_out) {
+  this->Flush(current_out);
+
+  size_t history_size = (size_t)(current_out - this->buffer_);
+  if (history_size > kWindowSize) history_size = kWindowSize;
+
+  std::memmove(this->buffer_, current_out - history_size, history_size);
+  this->base_ = this->consumed_ - history_size;
+  return this->buffer_ + history_size;
+}
+
+/**
+ * Append stored data to the window
+ *
+ * @param current_out current output position
+ * @param data stored data
+ * @param size size of stored data, in bytes
+ *
+ * @return new output position
+ */
+template <class Checksum>
+unsigned char* RollingWindow<Checksum>::Append(unsigned char* current_out,
+                                               const unsigned char* data,
+                                               size_t size) {
+  unsigned char* buffer_end = this->buffer_ + kRollingWindowSize;
+
+  while (size) {
+    if (current_out == buffer_end) current_out = this->Slide(current_out);
+
+    size_t length = (size_t)(buffer_end - current_out);
+    if (length > size) length = size;
+
+    std::memcpy(current_out, data, length);
+    current_out += length;
+    data += length;
+    size -= length;
+  }
+
+  return current_out;
+}
+
+/** Consume the bytes decompressed since the last call */
+template <class Checksum>
+void RollingWindow<Checksum>::Flush(unsigned char* current_out) {
+  const unsigned char* data = this->buffer_ + (this->consumed_ - this->base_);
+  this->Consume(data, (size_t)(current_out - data));
+}
+
+/**
+ * Decompress all blocks of a deflate stream into a rolling window, and
+ * verify its trailer
+ *
+ * @tparam Checksum NoChecksum, Crc32Checksum or Adler32Checksum
+ * @tparam Instrumentation NoInstrumentation or CountingInstrumentation
+ *
+ * @param bit_reader bit reader context, positioned on the first block
+ * @param window rolling window
+ * @param table_cache cache of decoder tables, if any
+ *
+ * @return number of bytes decompressed, or -1 in case of an error
+ */
+template <class Checksum, class Instrumentation = DefaultInstrumentation>
+size_t InflateWindowed(BitReader* bit_reader, RollingWindow<Checksum>* window,
+                       HuffmanTableCache* table_cache = nullptr) {
+  unsigned int final_block;
+  /* offsets in the window count the preset dictionary in */
+  size_t total_size = window->GetPrimedSize();
+  unsigned char* buffer = window->GetBuffer();
+  unsigned char* current_out = buffer + total_size;
+
+  do {
+    const unsigned char* stored_data;
+    size_t block_result;
+    size_t out_offset = (size_t)(current_out - buffer);
+
+    InflateStreamObserver* observer = window->GetObserver();
+    if (observer) {
+      window->Flush(current_out);
+
+      size_t history_size = out_offset < kWindowSize ? out_offset : kWindowSize;
+      InflateBlockBoundary boundary{bit_reader->GetBitOffset(),
+                                    total_size - window->GetPrimedSize(),
+                                    current_out - history_size, history_size};
+      /* stopped early; there is no trailer to check */
+      if (!observer->OnBlockBoundary(boundary)) return boundary.out_offset;
+    }
+
+    final_block = bit_reader->GetBits(1);
+    unsigned int block_type = bit_reader->GetBits(2);
+
+    switch (block_type) {
+      case 0:
+        Instrumentation::Count(bit_reader, &InflateStats::stored_blocks, 1);
+        block_result = ReferenceStored<Instrumentation>(
+            bit_reader, kInflateBadChecksum - 1 - total_size, &stored_data);
+        if (block_result == -1) return -1;
+        current_out = window->Append(current_out, stored_data, block_result);
+        break;
+
+      case 1:
+        Instrumentation::Count(bit_reader, &InflateStats::fixed_blocks, 1);
+        block_result =
+            DecompressBlock<FixedHuffmanBlock, ValidatedInput, Instrumentation>(
+                bit_reader, buffer, out_offset,
+                kRollingWindowSize - out_offset, nullptr, table_cache, window);
+        break;
+
+      case 2:
+        Instrumentation::Count(bit_reader, &InflateStats::dynamic_blocks, 1);
+        block_result =
+            DecompressBlock<DynamicHuffmanBlock, ValidatedInput,
+                            Instrumentation>(bit_reader, buffer, out_offset,
+                                             kRollingWindowSize - out_offset,
+                                             nullptr, table_cache, window);
+        break;
+
+      default:
+        return -1;
+    }
+
+    if (block_result == -1) return -1;
+
+    total_size += block_result;
+    current_out = buffer + (total_size - window->GetBase());
+  } while (!final_block);
+
+  Instrumentation::PhaseBegin(bit_reader, InflatePhase::kChecksum);
+  window->Flush(current_out);
+  Instrumentation::PhaseEnd(bit_reader, InflatePhase::kChecksum);
+
+  bit_reader->ByteAllign();
+
+  if constexpr (Checksum::kType != ChecksumType::kNone) {
+    const unsigned char* current_compressed_data = bit_reader->GetInBlock();
+
+    Instrumentation::PhaseBegin(bit_reader, InflatePhase::kChecksum);
+
+    if ((current_compressed_data + 4) > bit_reader->GetInBlockEnd())
+      return -1;
+    if (Checksum::ReadStored(current_compressed_data) !=
+        window->GetCheckSum())
+      return kInflateBadChecksum;
+    bit_reader->ModifyInBlock(4);
+
+    Instrumentation::PhaseEnd(bit_reader, InflatePhase::kChecksum);
+  }
+
+  return total_size - window->GetPrimedSize();
+}
 
 /**
  * Inflate zlib data
@@ -272,44 +1331,416 @@ enum ChecksumType { kNone = 0, kGZIP = 1, kZLIB = 2 };
  * @param out_size_max maximum size of decompression buffer, in bytes
  * @param checksum defines if the decompressor should use a specific checksum
  *
- * @return number of bytes decompressed, or -1 in case of an error
+ * @return status and number of bytes decompressed. When built with
+ * INFLATECPP_ENABLE_STATS, GetStats() then describes this call.
+ */
+InflateResult Decompressor::Feed(const void* compressed_data,
+                                 size_t compressed_data_size,
+                                 unsigned char* out, size_t out_size_max,
+                                 bool checksum) {
+  return this->Inflate<ValidatedInput>(compressed_data, compressed_data_size,
+                                       out, out_size_max, checksum);
+}
+
+/**
+ * Inflate zlib data produced by a trusted encoder, such as assets bundled by
+ * our own build. Per-symbol validation is skipped where the output buffer
+ * and the input have enough slack left; the stream is still never read or
+ * written out of bounds, and its Adler-32/CRC32 is always verified.
+ *
+ * @param compressed_data pointer to start of zlib data
+ * @param compressed_data_size size of zlib data, in bytes
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult Decompressor::FeedTrusted(const void* compressed_data,
+                                        size_t compressed_data_size,
+                                        unsigned char* out,
+                                        size_t out_size_max) {
+  return this->Inflate<TrustedInput>(compressed_data, compressed_data_size,
+                                     out, out_size_max, true);
+}
+
+/**
+ * Inflate zlib data without copying stored blocks. Stored-heavy streams,
+ * such as archives of already-compressed media, then decode at almost no
+ * cost.
+ *
+ * @param compressed_data pointer to start of zlib data; stored segments
+ * point into it, so it must outlive them
+ * @param compressed_data_size size of zlib data, in bytes
+ * @param out pointer to start of decompression buffer, for the Huffman-coded
+ * data and the match history it needs
+ * @param out_size_max maximum size of decompression buffer, in bytes; the
+ * decompressed size is always enough
+ * @param segments receives the decompressed data, in order
+ * @param checksum defines if the decompressor should use a specific checksum
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult Decompressor::FeedSegments(const void* compressed_data,
+                                         size_t compressed_data_size,
+                                         unsigned char* out,
+                                         size_t out_size_max,
+                                         std::vector<InflateSegment>* segments,
+                                         bool checksum) {
+  ChecksumType checksum_type;
+  InflateDictionary dictionary;
+  BitReader bit_reader;
+  size_t result;
+
+  InflateStatus status =
+      this->ReadStreamHeader(compressed_data, compressed_data_size,
+                             &bit_reader, &checksum_type, &dictionary);
+  if (status != InflateStatus::kOk) return {status, 0};
+
+  const InflateDictionary* preset = dictionary.size ? &dictionary : nullptr;
+
+  switch (checksum ? checksum_type : ChecksumType::kNone) {
+    case ChecksumType::kGZIP:
+      result = RunDecoderVariant([&]() {
+        return InflateSegments<Crc32Checksum>(&bit_reader, out, out_size_max,
+                                              segments, preset,
+                                              this->GetTableCache());
+      });
+      break;
+
+    case ChecksumType::kZLIB:
+      result = RunDecoderVariant([&]() {
+        return InflateSegments<Adler32Checksum>(&bit_reader, out, out_size_max,
+                                                segments, preset,
+                                                this->GetTableCache());
+      });
+      break;
+
+    default:
+      result = RunDecoderVariant([&]() {
+        return InflateSegments<NoChecksum>(&bit_reader, out, out_size_max,
+                                           segments, preset,
+                                           this->GetTableCache());
+      });
+      break;
+  }
+
+  return MakeInflateResult(result);
+}
+
+/**
+ * Register a preset dictionary for zlib streams with the FDICT flag. Only
+ * its last kWindowSize bytes are kept, as matches cannot reach further back,
+ * and streams use it in place, so priming the history costs nothing per
+ * stream.
+ *
+ * @param dictionary_data pointer to start of dictionary
+ * @param dictionary_size size of dictionary, in bytes
+ *
+ * @return DICTID of the dictionary, its Adler-32
+ */
+unsigned int Decompressor::AddDictionary(const void* dictionary_data,
+                                         size_t dictionary_size) {
+  const unsigned char* data = (const unsigned char*)dictionary_data;
+  unsigned int dictionary_id = Adler32Checksum::Update(
+      Adler32Checksum::Init(), data, dictionary_size);
+
+  if (dictionary_size > kWindowSize) {
+    data += dictionary_size - kWindowSize;
+    dictionary_size = kWindowSize;
+  }
+  this->dictionaries_[dictionary_id].assign(data, data + dictionary_size);
+
+  return dictionary_id;
+}
+
+/**
+ * Check the integrity of zlib data without materialising its output. The
+ * data is decoded into a rolling window that is reused from call to call,
+ * and its Adler-32/CRC32 is verified.
+ *
+ * @param compressed_data pointer to start of zlib data
+ * @param compressed_data_size size of zlib data, in bytes
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult Decompressor::Verify(const void* compressed_data,
+                                   size_t compressed_data_size) {
+  size_t out_size;
+  return this->InflateRange(compressed_data, compressed_data_size, 0, nullptr,
+                            0, &out_size, true);
+}
+
+/**
+ * Inflate a range of zlib data in constant memory. The data before the
+ * range is decoded into a rolling window and discarded, and so is the data
+ * after it, so that the whole stream can still be verified.
+ *
+ * @param compressed_data pointer to start of zlib data
+ * @param compressed_data_size size of zlib data, in bytes
+ * @param skip_size number of decompressed bytes to skip
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes
+ * @param checksum defines if the decompressor should use a specific checksum
+ *
+ * @return status and number of bytes written to out
+ */
+InflateResult Decompressor::FeedRange(const void* compressed_data,
+                                      size_t compressed_data_size,
+                                      size_t skip_size, unsigned char* out,
+                                      size_t out_size_max, bool checksum) {
+  size_t out_size;
+  InflateResult result =
+      this->InflateRange(compressed_data, compressed_data_size, skip_size, out,
+                         out_size_max, &out_size, checksum);
+  if (result.Ok()) result.size = out_size;
+  return result;
+}
+
+InflateResult Decompressor::InflateRange(const void* compressed_data,
+                                         size_t compressed_data_size,
+                                         size_t skip_size, unsigned char* out,
+                                         size_t out_size_max, size_t* out_size,
+                                         bool checksum,
+                                         InflateStreamObserver* observer) {
+  ChecksumType checksum_type;
+  InflateDictionary dictionary;
+  BitReader bit_reader;
+  size_t result;
+
+  InflateStatus status =
+      this->ReadStreamHeader(compressed_data, compressed_data_size,
+                             &bit_reader, &checksum_type, &dictionary);
+  if (status != InflateStatus::kOk) return {status, 0};
+
+  if (!this->window_buffer_)
+    this->window_buffer_.reset(new unsigned char[kRollingWindowSize]);
+  unsigned char* buffer = this->window_buffer_.get();
+
+  switch (checksum ? checksum_type : ChecksumType::kNone) {
+    case ChecksumType::kGZIP: {
+      RollingWindow<Crc32Checksum> window{buffer, skip_size, out,
+                                          out_size_max};
+      window.Prime(dictionary);
+      window.SetObserver(observer);
+      result = RunDecoderVariant([&]() {
+        return InflateWindowed(&bit_reader, &window, this->GetTableCache());
+      });
+      *out_size = window.GetOutSize();
+      break;
+    }
+
+    case ChecksumType::kZLIB: {
+      RollingWindow<Adler32Checksum> window{buffer, skip_size, out,
+                                            out_size_max};
+      window.Prime(dictionary);
+      window.SetObserver(observer);
+      result = RunDecoderVariant([&]() {
+        return InflateWindowed(&bit_reader, &window, this->GetTableCache());
+      });
+      *out_size = window.GetOutSize();
+      break;
+    }
+
+    default: {
+      RollingWindow<NoChecksum> window{buffer, skip_size, out, out_size_max};
+      window.Prime(dictionary);
+      window.SetObserver(observer);
+      result = RunDecoderVariant([&]() {
+        return InflateWindowed(&bit_reader, &window, this->GetTableCache());
+      });
+      *out_size = window.GetOutSize();
+      break;
+    }
+  }
+
+  return MakeInflateResult(result);
+}
+
+/**
+ * Inflate a raw deflate stream, with no gzip or zlib header and trailer to
+ * detect, such as the entries of a ZIP archive. Feed() would mistake raw
+ * streams that happen to start like a zlib header for one.
+ *
+ * @param compressed_data pointer to start of deflate data
+ * @param compressed_data_size size of deflate data, in bytes
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult Decompressor::FeedRaw(const void* compressed_data,
+                                    size_t compressed_data_size,
+                                    unsigned char* out, size_t out_size_max) {
+  unsigned char* in = (unsigned char*)compressed_data;
+  BitReader bit_reader;
+
+  this->BeginStream(&bit_reader);
+  bit_reader.Init(in, in + compressed_data_size);
+
+  return MakeInflateResult(RunDecoderVariant([&]() {
+    return InflateBlocks<NoChecksum>(&bit_reader, out, out_size_max, nullptr,
+                                     this->GetTableCache());
+  }));
+}
+
+/**
+ * Inflate a chunk of a raw deflate stream that was flushed on both ends: it
+ * starts on a byte boundary with no match reaching before it, and ends
+ * either with the final block or with the input, right after the empty
+ * stored block of a sync flush. Chunks of a stream flushed that way decode
+ * independently, e.g. on different threads.
+ *
+ * @param compressed_data pointer to start of the chunk
+ * @param compressed_data_size size of the chunk, in bytes
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult Decompressor::FeedRawChunk(const void* compressed_data,
+                                         size_t compressed_data_size,
+                                         unsigned char* out,
+                                         size_t out_size_max) {
+  unsigned char* in = (unsigned char*)compressed_data;
+  BitReader bit_reader;
+
+  this->BeginStream(&bit_reader);
+  bit_reader.Init(in, in + compressed_data_size);
+
+  return MakeInflateResult(RunDecoderVariant([&]() {
+    return InflateBlocks<NoChecksum>(&bit_reader, out, out_size_max, nullptr,
+                                     this->GetTableCache(), true);
+  }));
+}
+
+/**
+ * Inflate zlib data in constant memory, handing the decompressed data to an
+ * observer as it is produced rather than writing it to a buffer. The
+ * observer also sees every block boundary, where it can capture an
+ * InflateCheckpoint to resume from later, or stop decoding.
+ *
+ * @param compressed_data pointer to start of zlib data
+ * @param compressed_data_size size of zlib data, in bytes
+ * @param observer receives the decompressed data and the block boundaries
+ * @param checksum defines if the decompressor should use a specific checksum;
+ * it is not verified if the observer stops decoding
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult Decompressor::FeedStreaming(const void* compressed_data,
+                                          size_t compressed_data_size,
+                                          InflateStreamObserver* observer,
+                                          bool checksum) {
+  size_t out_size;
+  return this->InflateRange(compressed_data, compressed_data_size, 0, nullptr,
+                            0, &out_size, checksum, observer);
+}
+
+/**
+ * Resume decoding zlib data at a checkpoint captured by the observer of an
+ * earlier FeedStreaming() call on the same data. The checksum cannot be
+ * verified, as it covers the data before the checkpoint too.
+ *
+ * @param compressed_data pointer to start of zlib data
+ * @param compressed_data_size size of zlib data, in bytes
+ * @param checkpoint checkpoint to resume at
+ * @param observer receives the decompressed data after the checkpoint and the
+ * block boundaries; offsets count from the checkpoint
+ *
+ * @return status and number of bytes decompressed after the checkpoint
  */
-unsigned int Decompressor::Feed(const void* compressed_data,
-                                unsigned int compressed_data_size,
-                                unsigned char* out, unsigned int out_size_max,
-                                bool checksum) {
+InflateResult Decompressor::ResumeStreaming(
+    const void* compressed_data, size_t compressed_data_size,
+    const InflateCheckpoint& checkpoint, InflateStreamObserver* observer) {
+  ChecksumType checksum_type;
+  InflateDictionary dictionary;
+  BitReader bit_reader;
+
+  InflateStatus status =
+      this->ReadStreamHeader(compressed_data, compressed_data_size,
+                             &bit_reader, &checksum_type, &dictionary);
+  if (status != InflateStatus::kOk) return {status, 0};
+
+  if (checkpoint.window.size() > kWindowSize ||
+      bit_reader.SeekBit(checkpoint.in_bit_offset) < 0)
+    return {InflateStatus::kDataError, 0};
+
+  if (!this->window_buffer_)
+    this->window_buffer_.reset(new unsigned char[kRollingWindowSize]);
+
+  /* the history before the checkpoint primes the window like a preset
+   * dictionary */
+  RollingWindow<NoChecksum> window{this->window_buffer_.get(), 0, nullptr, 0};
+  window.Prime(InflateDictionary{checkpoint.window.data(),
+                                 (unsigned int)checkpoint.window.size()});
+  window.SetObserver(observer);
+
+  return MakeInflateResult(RunDecoderVariant([&]() {
+    return InflateWindowed(&bit_reader, &window, this->GetTableCache());
+  }));
+}
+
+/**
+ * Reset the counters of a new stream
+ *
+ * @param bit_reader bit reader context of the stream
+ */
+void Decompressor::BeginStream(BitReader* bit_reader) {
+  this->stats_ = InflateStats{};
+#ifdef INFLATECPP_ENABLE_STATS
+  bit_reader->SetStats(&this->stats_);
+  bit_reader->SetPhaseObserver(this->observer_);
+#else
+  (void)bit_reader;
+#endif /* INFLATECPP_ENABLE_STATS */
+}
+
+/**
+ * Reset the counters and skip the gzip or zlib header, if any
+ *
+ * @param compressed_data pointer to start of zlib data
+ * @param compressed_data_size size of zlib data, in bytes
+ * @param bit_reader receives the bit reader context, positioned on the first
+ * block
+ * @param checksum_type receives the checksum the stream is framed with
+ * @param dictionary receives the preset dictionary, or an empty one
+ *
+ * @return kOk, kDataError or kNeedDictionary
+ */
+InflateStatus Decompressor::ReadStreamHeader(const void* compressed_data,
+                                             size_t compressed_data_size,
+                                             BitReader* bit_reader,
+                                             ChecksumType* checksum_type,
+                                             InflateDictionary* dictionary) {
   unsigned char* current_compressed_data = (unsigned char*)compressed_data;
   unsigned char* end_compressed_data =
       current_compressed_data + compressed_data_size;
-  unsigned int final_block;
-  unsigned int current_out_offset;
-  unsigned long check_sum = 0;
 
-  ChecksumType checksum_type = ChecksumType::kNone;
-  BitReader bit_reader;
+  *checksum_type = ChecksumType::kNone;
+  *dictionary = InflateDictionary{nullptr, 0};
+
+  this->BeginStream(bit_reader);
 
-  if ((current_compressed_data + 2) > end_compressed_data) return -1;
+  DefaultInstrumentation::PhaseBegin(bit_reader, InflatePhase::kHeader);
+
+  if ((current_compressed_data + 2) > end_compressed_data)
+    return InflateStatus::kDataError;
 
   if (current_compressed_data[0] == 0x1f &&
       current_compressed_data[1] == 0x8b) {
     current_compressed_data += 2;
     if ((current_compressed_data + 8) > end_compressed_data ||
         current_compressed_data[0] != 0x08)
-      return -1;
+      return InflateStatus::kDataError;
 
     current_compressed_data++;
 
     unsigned char flags = *current_compressed_data++;
     current_compressed_data += 6;
 
-    if (flags & 0x02) {
-      if ((current_compressed_data + 2) > end_compressed_data) return -1;
-
-      current_compressed_data += 2;
-    }
-
     if (flags & 0x04) {
-      if ((current_compressed_data + 2) > end_compressed_data) return -1;
+      if ((current_compressed_data + 2) > end_compressed_data)
+        return InflateStatus::kDataError;
 
       unsigned short extra_field_len =
           ((unsigned short)current_compressed_data[0]) |
@@ -317,14 +1748,15 @@ unsigned int Decompressor::Feed(const void* compressed_data,
       current_compressed_data += 2;
 
       if ((current_compressed_data + extra_field_len) > end_compressed_data)
-        return -1;
+        return InflateStatus::kDataError;
 
       current_compressed_data += extra_field_len;
     }
 
     if (flags & 0x08) {
       do {
-        if (current_compressed_data >= end_compressed_data) return -1;
+        if (current_compressed_data >= end_compressed_data)
+          return InflateStatus::kDataError;
 
         current_compressed_data++;
       } while (current_compressed_data[-1]);
@@ -332,15 +1764,24 @@ unsigned int Decompressor::Feed(const void* compressed_data,
 
     if (flags & 0x10) {
       do {
-        if (current_compressed_data >= end_compressed_data) return -1;
+        if (current_compressed_data >= end_compressed_data)
+          return InflateStatus::kDataError;
 
         current_compressed_data++;
       } while (current_compressed_data[-1]);
     }
 
-    if (flags & 0x20) return -1;
+    /* the header CRC16 comes last, after the name and the comment */
+    if (flags & 0x02) {
+      if ((current_compressed_data + 2) > end_compressed_data)
+        return InflateStatus::kDataError;
+
+      current_compressed_data += 2;
+    }
 
-    checksum_type = ChecksumType::kGZIP;
+    if (flags & 0x20) return InflateStatus::kDataError;
+
+    *checksum_type = ChecksumType::kGZIP;
   } else if ((current_compressed_data[0] & 0x0f) == 0x08) {
     unsigned char CMF = current_compressed_data[0];
     unsigned char FLG = current_compressed_data[1];
@@ -349,108 +1790,71 @@ unsigned int Decompressor::Feed(const void* compressed_data,
     if ((CMF >> 4) <= 7 && (check % 31) == 0) {
       current_compressed_data += 2;
       if (FLG & 0x20) {
-        if ((current_compressed_data + 4) > end_compressed_data) return -1;
-        current_compressed_data += 4;
-      }
-    }
+        if ((current_compressed_data + 4) > end_compressed_data)
+          return InflateStatus::kDataError;
 
-    checksum_type = ChecksumType::kZLIB;
-  }
-
-  if (checksum && checksum_type == ChecksumType::kZLIB)
-    check_sum = adler32_z(0, nullptr, 0);
-
-  bit_reader.Init(current_compressed_data, end_compressed_data);
-  current_out_offset = 0;
-
-  do {
-    unsigned int block_type;
-    unsigned int block_result;
-
-    final_block = bit_reader.GetBits(1);
-    block_type = bit_reader.GetBits(2);
+        unsigned int dictionary_id =
+            Adler32Checksum::ReadStored(current_compressed_data);
+        auto found = this->dictionaries_.find(dictionary_id);
+        if (found == this->dictionaries_.end())
+          return InflateStatus::kNeedDictionary;
 
-    switch (block_type) {
-      case 0:
-        block_result = CopyStored(&bit_reader, out, current_out_offset,
-                                  out_size_max - current_out_offset);
-        break;
-
-      case 1:
-        block_result = DecompressBlock(&bit_reader, 0, out, current_out_offset,
-                                       out_size_max - current_out_offset);
-        break;
-
-      case 2:
-        block_result = DecompressBlock(&bit_reader, 1, out, current_out_offset,
-                                       out_size_max - current_out_offset);
-        break;
-
-      case 3:
-        return -1;
-    }
-
-    if (block_result == -1) return -1;
-
-    if (checksum) {
-      switch (checksum_type) {
-        case ChecksumType::kGZIP:
-          check_sum =
-              crc32_4bytes(out + current_out_offset, block_result, check_sum);
-          break;
-
-        case ChecksumType::kZLIB:
-          check_sum =
-              adler32_z(check_sum, out + current_out_offset, block_result);
-          break;
-
-        default:
-          break;
+        *dictionary = InflateDictionary{found->second.data(),
+                                        (unsigned int)found->second.size()};
+        current_compressed_data += 4;
       }
     }
 
-    current_out_offset += block_result;
-  } while (!final_block);
-
-  bit_reader.ByteAllign();
-  current_compressed_data = bit_reader.GetInBlock();
-
-  if (checksum) {
-    unsigned int stored_check_sum;
-
-    switch (checksum_type) {
-      case ChecksumType::kGZIP:
-        if ((current_compressed_data + 4) > end_compressed_data) return -1;
-
-        stored_check_sum = ((unsigned int)current_compressed_data[0]);
-        stored_check_sum |= ((unsigned int)current_compressed_data[1]) << 8;
-        stored_check_sum |= ((unsigned int)current_compressed_data[2]) << 16;
-        stored_check_sum |= ((unsigned int)current_compressed_data[3]) << 24;
-
-        if (stored_check_sum != check_sum) return -1;
-
-        current_compressed_data += 4;
-        break;
-
-      case ChecksumType::kZLIB:
-        if ((current_compressed_data + 4) > end_compressed_data) return -1;
-
-        stored_check_sum = ((unsigned int)current_compressed_data[0]) << 24;
-        stored_check_sum |= ((unsigned int)current_compressed_data[1]) << 16;
-        stored_check_sum |= ((unsigned int)current_compressed_data[2]) << 8;
-        stored_check_sum |= ((unsigned int)current_compressed_data[3]);
+    *checksum_type = ChecksumType::kZLIB;
+  }
 
-        if (stored_check_sum != check_sum) return -1;
+  bit_reader->Init(current_compressed_data, end_compressed_data);
 
-        current_compressed_data += 4;
-        break;
+  DefaultInstrumentation::PhaseEnd(bit_reader, InflatePhase::kHeader);
+  return InflateStatus::kOk;
+}
 
-      default:
-        break;
-    }
+template <class BoundsCheck>
+InflateResult Decompressor::Inflate(const void* compressed_data,
+                                    size_t compressed_data_size,
+                                    unsigned char* out, size_t out_size_max,
+                                    bool checksum) {
+  ChecksumType checksum_type;
+  InflateDictionary dictionary;
+  BitReader bit_reader;
+  size_t result;
+
+  InflateStatus status =
+      this->ReadStreamHeader(compressed_data, compressed_data_size,
+                             &bit_reader, &checksum_type, &dictionary);
+  if (status != InflateStatus::kOk) return {status, 0};
+
+  const InflateDictionary* preset = dictionary.size ? &dictionary : nullptr;
+
+  switch (checksum ? checksum_type : ChecksumType::kNone) {
+    case ChecksumType::kGZIP:
+      result = RunDecoderVariant([&]() {
+        return InflateBlocks<Crc32Checksum, BoundsCheck>(
+            &bit_reader, out, out_size_max, preset, this->GetTableCache());
+      });
+      break;
+
+    case ChecksumType::kZLIB:
+      result = RunDecoderVariant([&]() {
+        return InflateBlocks<Adler32Checksum, BoundsCheck>(
+            &bit_reader, out, out_size_max, preset, this->GetTableCache());
+      });
+      break;
+
+    default:
+      result = RunDecoderVariant([&]() {
+        return InflateBlocks<NoChecksum, BoundsCheck>(
+            &bit_reader, out, out_size_max, preset, this->GetTableCache());
+      });
+      break;
   }
 
-  return current_out_offset;
+  return MakeInflateResult(result);
 }
 
 #endif /* !_DECOMPRESSOR_H */
@@ -5,49 +5,74 @@
 
 constexpr auto kMaxSymbols = 288;
 constexpr auto kCodeLenSyms = 19;
-constexpr auto kFastSymbolBits = 10;
 
-class HuffmanDecoder {
+/* Each table picks the width of its fast symbol lookup from its code
+ * lengths, between kMinFastSymbolBits and the maximum of its decoder type.
+ * Code length codes are never longer than 7 bits. */
+constexpr auto kMinFastSymbolBits = 7;
+constexpr auto kCodeLenFastBits = 7;
+constexpr auto kLiteralFastBits = 12;
+constexpr auto kOffsetFastBits = 10;
+
+/* fast lookup entries: symbol in the low bits, code length above */
+constexpr auto kFastSymbolShift = 12;
+constexpr auto kFastSymbolMask = (1 << kFastSymbolShift) - 1;
+
+/**
+ * Canonical Huffman decoder for an alphabet of up to kSymbols symbols. All
+ * of its state is held inline and packed into 8 and 16-bit entries, fast
+ * lookup first, so that a block's literal/length and distance decoders
+ * take two adjacent runs of cache lines.
+ */
+template <int kMaxFastBits, int kSymbols>
+class alignas(64) HuffmanDecoder {
  public:
   HuffmanDecoder(){};
   ~HuffmanDecoder() = default;
 
-  int PrepareTable(unsigned int*, const int, const int, unsigned char*);
-  int FinalizeTable(unsigned int*);
+  int PrepareTable(const int, const unsigned char*);
+  int FinalizeTable();
   static int ReadRawLengths(const int, const int, const int, unsigned char*,
                             BitReader*);
-  int ReadLength(const unsigned int*, const int, const int, unsigned char*,
-                 BitReader*);
+  int ReadLength(const int, const int, unsigned char*, BitReader*);
 
-  unsigned int ReadValue(const unsigned int*, BitReader*);
+  template <bool kBuffered = false>
+  unsigned int ReadValue(BitReader*);
 
  private:
-  unsigned int fast_symbol_[1 << kFastSymbolBits];
-  unsigned int start_index_[16];
-  unsigned int symbols_;
-  int num_sorted_;
-  int starting_pos_[16];
+  static_assert(kSymbols <= (1 << kFastSymbolShift),
+                "symbols must fit below the code length of fast entries");
+
+  /* hot: looked up for every symbol */
+  unsigned short fast_symbol_[1 << kMaxFastBits];
+  unsigned short fast_mask_;
+
+  /* slow path, for codes longer than the fast lookup */
+  short start_index_[16];
+  unsigned short rev_symbol_[kSymbols];
+  unsigned char rev_code_length_[kSymbols];
+
+  /* only used while building */
+  short num_sorted_;
+  short starting_pos_[16];
 };
 
 /**
  * Prepare huffman tables
  *
- * @param rev_symbol_table array of 2 * symbols entries for storing the reverse
- * lookup table
+ * @param read_symbols number of code lengths, at most kSymbols; the other
+ * symbols are unused
  * @param code_length codeword lengths table
  *
  * @return 0 for success, -1 for failure
  */
-int HuffmanDecoder::PrepareTable(unsigned int* rev_symbol_table,
-                                 const int read_symbols, const int symbols,
-                                 unsigned char* code_length) {
+template <int kMaxFastBits, int kSymbols>
+int HuffmanDecoder<kMaxFastBits, kSymbols>::PrepareTable(
+    const int read_symbols, const unsigned char* code_length) {
   int num_symbols_per_len[16];
   int i;
 
-  if (read_symbols < 0 || read_symbols > kMaxSymbols || symbols < 0 ||
-      symbols > kMaxSymbols || read_symbols > symbols)
-    return -1;
-  this->symbols_ = symbols;
+  if (read_symbols < 0 || read_symbols > kSymbols) return -1;
 
   for (i = 0; i < 16; i++) num_symbols_per_len[i] = 0;
 
@@ -63,11 +88,26 @@ int HuffmanDecoder::PrepareTable(unsigned int* rev_symbol_table,
     this->num_sorted_ += num_symbols_per_len[i];
   }
 
-  for (i = 0; i < symbols; i++) rev_symbol_table[i] = -1;
+  /* Narrowest fast lookup that leaves less than 1/256 of the code space to
+   * the slow path; as narrow as the longest code if that is shorter still */
+  int fast_bits = 15;
+  while (fast_bits > 0 && !num_symbols_per_len[fast_bits]) fast_bits--;
+
+  unsigned int slow_space = 0;
+  while (fast_bits > kMinFastSymbolBits) {
+    slow_space += num_symbols_per_len[fast_bits] << (15 - fast_bits);
+    if (slow_space >= (1U << (15 - 8))) break;
+    fast_bits--;
+  }
+  if (fast_bits > kMaxFastBits) fast_bits = kMaxFastBits;
+
+  this->fast_mask_ = (1U << fast_bits) - 1;
+
+  for (i = 0; i < kSymbols; i++) this->rev_symbol_[i] = 0xffff;
 
   for (i = 0; i < read_symbols; i++) {
     if (code_length[i])
-      rev_symbol_table[this->starting_pos_[code_length[i]]++] = i;
+      this->rev_symbol_[this->starting_pos_[code_length[i]]++] = i;
   }
 
   return 0;
@@ -76,19 +116,16 @@ int HuffmanDecoder::PrepareTable(unsigned int* rev_symbol_table,
 /**
  * Finalize huffman codewords for decoding
  *
- * @param rev_symbol_table array of 2 * symbols entries that contains the
- * reverse lookup table
- *
  * @return 0 for success, -1 for failure
  */
-int HuffmanDecoder::FinalizeTable(unsigned int* rev_symbol_table) {
-  const int symbols = this->symbols_;
+template <int kMaxFastBits, int kSymbols>
+int HuffmanDecoder<kMaxFastBits, kSymbols>::FinalizeTable() {
+  const int fast_mask = this->fast_mask_;
   unsigned int canonical_code_word = 0;
-  unsigned int* rev_code_length_table = rev_symbol_table + symbols;
   int canonical_length = 1;
   int i;
 
-  for (i = 0; i < (1 << kFastSymbolBits); i++) this->fast_symbol_[i] = 0;
+  for (i = 0; i <= fast_mask; i++) this->fast_symbol_[i] = 0;
   for (i = 0; i < 16; i++) this->start_index_[i] = 0;
 
   i = 0;
@@ -97,12 +134,12 @@ int HuffmanDecoder::FinalizeTable(unsigned int* rev_symbol_table) {
     this->start_index_[canonical_length] = i - canonical_code_word;
 
     while (i < this->starting_pos_[canonical_length]) {
-      if (i >= symbols) return -1;
-      rev_code_length_table[i] = canonical_length;
+      if (i >= kSymbols) return -1;
+      this->rev_code_length_[i] = canonical_length;
 
       if (canonical_code_word >= (1U << canonical_length)) return -1;
 
-      if (canonical_length <= kFastSymbolBits) {
+      if ((1 << canonical_length) <= (fast_mask + 1)) {
         unsigned int rev_word;
 
         /* Get upside down codeword (branchless method by Eric Biggers) */
@@ -113,10 +150,10 @@ int HuffmanDecoder::FinalizeTable(unsigned int* rev_symbol_table) {
         rev_word = ((rev_word & 0x00ff) << 8) | ((rev_word & 0xff00) >> 8);
         rev_word = rev_word >> (16 - canonical_length);
 
-        int slots = 1 << (kFastSymbolBits - canonical_length);
+        int slots = (fast_mask + 1) >> canonical_length;
         while (slots) {
           this->fast_symbol_[rev_word] =
-              (rev_symbol_table[i] & 0xffffff) | (canonical_length << 24);
+              this->rev_symbol_[i] | (canonical_length << kFastSymbolShift);
           rev_word += (1 << canonical_length);
           slots--;
         }
@@ -129,9 +166,9 @@ int HuffmanDecoder::FinalizeTable(unsigned int* rev_symbol_table) {
     canonical_code_word <<= 1;
   }
 
-  while (i < symbols) {
-    rev_symbol_table[i] = -1;
-    rev_code_length_table[i++] = 0;
+  while (i < kSymbols) {
+    this->rev_symbol_[i] = 0xffff;
+    this->rev_code_length_[i++] = 0;
   }
 
   return 0;
@@ -148,10 +185,10 @@ int HuffmanDecoder::FinalizeTable(unsigned int* rev_symbol_table) {
  *
  * @return 0 for success, -1 for failure
  */
-int HuffmanDecoder::ReadRawLengths(const int len_bits, const int read_symbols,
-                                   const int symbols,
-                                   unsigned char* code_length,
-                                   BitReader* bit_reader) {
+template <int kMaxFastBits, int kSymbols>
+int HuffmanDecoder<kMaxFastBits, kSymbols>::ReadRawLengths(
+    const int len_bits, const int read_symbols, const int symbols,
+    unsigned char* code_length, BitReader* bit_reader) {
   const unsigned char code_len_syms[kCodeLenSyms] = {
       16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
   int i;
@@ -178,7 +215,6 @@ int HuffmanDecoder::ReadRawLengths(const int len_bits, const int read_symbols,
 /**
  * Read huffman-encoded code lengths
  *
- * @param tables_rev_symbol_table reverse lookup table for code lengths
  * @param read_symbols number of symbols actually read
  * @param symbols number of symbols to build codes for
  * @param code_length output code lengths table
@@ -186,10 +222,10 @@ int HuffmanDecoder::ReadRawLengths(const int len_bits, const int read_symbols,
  *
  * @return 0 for success, -1 for failure
  */
-int HuffmanDecoder::ReadLength(const unsigned int* tables_rev_symbol_table,
-                               const int read_symbols, const int symbols,
-                               unsigned char* code_length,
-                               BitReader* bit_reader) {
+template <int kMaxFastBits, int kSymbols>
+int HuffmanDecoder<kMaxFastBits, kSymbols>::ReadLength(
+    const int read_symbols, const int symbols, unsigned char* code_length,
+    BitReader* bit_reader) {
   int i;
   if (read_symbols < 0 || symbols < 0 || read_symbols > symbols) return -1;
 
@@ -197,7 +233,7 @@ int HuffmanDecoder::ReadLength(const unsigned int* tables_rev_symbol_table,
   unsigned int previous_length = 0;
 
   while (i < read_symbols) {
-    unsigned int length = this->ReadValue(tables_rev_symbol_table, bit_reader);
+    unsigned int length = this->ReadValue(bit_reader);
     if (length == -1) return -1;
 
     if (length < 16) {
@@ -236,32 +272,41 @@ int HuffmanDecoder::ReadLength(const unsigned int* tables_rev_symbol_table,
 /**
  * Decode next symbol
  *
- * @param rev_symbol_table reverse lookup table
+ * @tparam kBuffered true if the caller guarantees at least 15 bits in the
+ * shifter, so that no refill is attempted
  * @param bit_reader bit reader context
  *
- * @return symbol, or -1 for error
+ * @return symbol, or -1 for error, including a code that runs past the end
+ * of the input: the padding would otherwise decode forever when the
+ * all-zero code is a literal and the output has no bound
  */
-unsigned int HuffmanDecoder::ReadValue(const unsigned int* rev_symbol_table,
-                                       BitReader* bit_reader) {
-  unsigned int stream = bit_reader->PeekBits();
-  unsigned int fast_sym_bits =
-      this->fast_symbol_[stream & ((1 << kFastSymbolBits) - 1)];
+template <int kMaxFastBits, int kSymbols>
+template <bool kBuffered>
+unsigned int HuffmanDecoder<kMaxFastBits, kSymbols>::ReadValue(
+    BitReader* bit_reader) {
+  unsigned int stream =
+      kBuffered ? bit_reader->PeekBufferedBits() : bit_reader->PeekBits();
+  unsigned int fast_sym_bits = this->fast_symbol_[stream & this->fast_mask_];
   if (fast_sym_bits) {
-    bit_reader->ConsumeBits(fast_sym_bits >> 24);
-    return fast_sym_bits & 0xffffff;
+    INFLATE_STATS_ADD(bit_reader, fast_symbol_hits, 1);
+    bit_reader->ConsumeBits(fast_sym_bits >> kFastSymbolShift);
+    if (!kBuffered && bit_reader->IsOverrun()) return -1;
+    return fast_sym_bits & kFastSymbolMask;
   }
-  const unsigned int* rev_code_length_table = rev_symbol_table + this->symbols_;
   unsigned int code_word = 0;
   int bits = 1;
 
   do {
+    INFLATE_STATS_ADD(bit_reader, slow_path_iterations, 1);
     code_word |= (stream & 1);
 
-    unsigned int table_index = this->start_index_[bits] + code_word;
-    if (table_index < this->symbols_) {
-      if (bits == rev_code_length_table[table_index]) {
+    unsigned int table_index = this->start_index_[bits] + (int)code_word;
+    if (table_index < kSymbols) {
+      if (bits == this->rev_code_length_[table_index]) {
+        INFLATE_STATS_ADD(bit_reader, slow_path_symbols, 1);
         bit_reader->ConsumeBits(bits);
-        return rev_symbol_table[table_index];
+        if (!kBuffered && bit_reader->IsOverrun()) return -1;
+        return this->rev_symbol_[table_index];
       }
     }
     code_word <<= 1;
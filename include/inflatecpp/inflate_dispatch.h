@@ -0,0 +1,132 @@
+#ifndef _INFLATE_DISPATCH_H
+#define _INFLATE_DISPATCH_H
+
+#include <cstddef>
+#include <cstdlib>
+
+#include "adler32.h"
+#include "cpu_features.h"
+#include "crc32.h"
+
+/*-- runtime selection of kernel variants --*/
+
+/**
+ * Variants of the block decoder. They all run the same templates; the
+ * specialised ones are compiled for more instruction set extensions, with
+ * the whole decoder, match copies included, inlined into them. With BMI2,
+ * the bit reader's variable shifts and (1 << n) - 1 masks, in the symbol
+ * lookups and the extra bits of lengths and distances, become shrx and bzhi,
+ * which neither depend on nor write the flags.
+ */
+enum class InflateDecoderVariant { kGeneric = 0, kBmi2 = 1, kAvx2Bmi2 = 2 };
+
+/** Kernels bound for the features of the host */
+struct InflateKernels {
+  unsigned int features;
+  InflateDecoderVariant decoder;
+  unsigned int (*crc32)(const void*, unsigned int, unsigned int);
+  unsigned int (*adler32)(unsigned int, const unsigned char*, unsigned int);
+};
+
+/**
+ * Pick the fastest variant of every kernel for a set of features
+ *
+ * @param features InflateCpuFeature bits
+ *
+ * @return kernels
+ */
+InflateKernels BindInflateKernels(unsigned int features) {
+  InflateKernels kernels;
+
+  kernels.features = features;
+  kernels.decoder = InflateDecoderVariant::kGeneric;
+  kernels.crc32 = crc32_4bytes;
+  kernels.adler32 = adler32_z;
+
+#ifdef INFLATECPP_X86_DISPATCH
+  if ((features & kCpuAvx2) && (features & kCpuBmi2))
+    kernels.decoder = InflateDecoderVariant::kAvx2Bmi2;
+  else if (features & kCpuBmi2)
+    kernels.decoder = InflateDecoderVariant::kBmi2;
+  if ((features & kCpuPclmul) && (features & kCpuSse41))
+    kernels.crc32 = crc32_pclmul;
+  if (features & kCpuSsse3) kernels.adler32 = adler32_ssse3;
+  if (features & kCpuAvx2) kernels.adler32 = adler32_avx2;
+#endif /* INFLATECPP_X86_DISPATCH */
+
+#ifdef INFLATECPP_ARM_DISPATCH
+  if (features & kCpuArmCrc32) kernels.crc32 = crc32_armv8;
+#endif /* INFLATECPP_ARM_DISPATCH */
+
+  return kernels;
+}
+
+/**
+ * Kernels in use. They are bound on first use, for the detected features
+ * masked by the INFLATECPP_CPU_FEATURES environment variable, if set (e.g.
+ * INFLATECPP_CPU_FEATURES=0 for the baseline kernels).
+ */
+InflateKernels* GetInflateKernelSlot() {
+  static InflateKernels kernels = []() {
+    unsigned int features = DetectCpuFeatures();
+    const char* mask = std::getenv("INFLATECPP_CPU_FEATURES");
+    if (mask) features &= (unsigned int)std::strtoul(mask, nullptr, 0);
+    return BindInflateKernels(features);
+  }();
+  return &kernels;
+}
+
+const InflateKernels& GetInflateKernels() { return *GetInflateKernelSlot(); }
+
+/**
+ * Restrict the kernels to a subset of the host features, for testing and
+ * benchmarking a specific variant. Not safe while other threads decode.
+ *
+ * @param features InflateCpuFeature bits to allow; 0 for the baseline
+ * kernels, kCpuAllFeatures for the fastest ones
+ *
+ * @return features actually in use
+ */
+unsigned int ForceInflateCpuFeatures(unsigned int features) {
+  *GetInflateKernelSlot() = BindInflateKernels(DetectCpuFeatures() & features);
+  return GetInflateKernels().features;
+}
+
+#ifdef INFLATECPP_X86_DISPATCH
+template <class Function>
+__attribute__((target("bmi,bmi2"), flatten)) size_t RunBmi2Decoder(
+    const Function& function) {
+  return function();
+}
+
+template <class Function>
+__attribute__((target("avx2,bmi,bmi2"), flatten)) size_t RunAvx2Bmi2Decoder(
+    const Function& function) {
+  return function();
+}
+#endif /* INFLATECPP_X86_DISPATCH */
+
+/**
+ * Run a decode with the block decoder variant in use
+ *
+ * @param function decode to run, a callable returning the decompressed size
+ * or kInflateError
+ *
+ * @return what function returns
+ */
+template <class Function>
+size_t RunDecoderVariant(const Function& function) {
+#ifdef INFLATECPP_X86_DISPATCH
+  switch (GetInflateKernels().decoder) {
+    case InflateDecoderVariant::kBmi2:
+      return RunBmi2Decoder(function);
+    case InflateDecoderVariant::kAvx2Bmi2:
+      return RunAvx2Bmi2Decoder(function);
+    default:
+      break;
+  }
+#endif /* INFLATECPP_X86_DISPATCH */
+  return function();
+}
+
+#endif /* !_INFLATE_DISPATCH_H */
@@ -0,0 +1,147 @@
+#ifndef _INFLATE_POLICIES_H
+#define _INFLATE_POLICIES_H
+
+#include "bit_reader.h"
+#include "inflate_dispatch.h"
+#include "inflate_stats.h"
+
+/*-- compile-time policies for the block decoder --*/
+
+enum ChecksumType { kNone = 0, kGZIP = 1, kZLIB = 2 };
+
+/* the checksum kernels take 32-bit lengths; larger runs are fed in chunks */
+constexpr size_t kChecksumChunk = 1U << 30;
+
+/* block type */
+
+struct FixedHuffmanBlock {
+  static constexpr bool kDynamic = false;
+};
+
+struct DynamicHuffmanBlock {
+  static constexpr bool kDynamic = true;
+};
+
+/* checksum kind */
+
+struct NoChecksum {
+  static constexpr ChecksumType kType = ChecksumType::kNone;
+
+  static unsigned int Init() { return 0; }
+  static unsigned int Update(unsigned int check_sum, const unsigned char*,
+                             size_t) {
+    return check_sum;
+  }
+  static unsigned int ReadStored(const unsigned char*) { return 0; }
+};
+
+struct Crc32Checksum {
+  static constexpr ChecksumType kType = ChecksumType::kGZIP;
+
+  static unsigned int Init() { return 0; }
+  static unsigned int Update(unsigned int check_sum, const unsigned char* data,
+                             size_t length) {
+    const InflateKernels& kernels = GetInflateKernels();
+    while (length > kChecksumChunk) {
+      check_sum = kernels.crc32(data, kChecksumChunk, check_sum);
+      data += kChecksumChunk;
+      length -= kChecksumChunk;
+    }
+    return kernels.crc32(data, (unsigned int)length, check_sum);
+  }
+  /** gzip stores the CRC32 little-endian */
+  static unsigned int ReadStored(const unsigned char* in) {
+    return ((unsigned int)in[0]) | (((unsigned int)in[1]) << 8) |
+           (((unsigned int)in[2]) << 16) | (((unsigned int)in[3]) << 24);
+  }
+};
+
+struct Adler32Checksum {
+  static constexpr ChecksumType kType = ChecksumType::kZLIB;
+
+  static unsigned int Init() { return adler32_z(0, nullptr, 0); }
+  static unsigned int Update(unsigned int check_sum, const unsigned char* data,
+                             size_t length) {
+    const InflateKernels& kernels = GetInflateKernels();
+    while (length > kChecksumChunk) {
+      check_sum = kernels.adler32(check_sum, data, kChecksumChunk);
+      data += kChecksumChunk;
+      length -= kChecksumChunk;
+    }
+    return kernels.adler32(check_sum, data, (unsigned int)length);
+  }
+  /** zlib stores the Adler-32 big-endian */
+  static unsigned int ReadStored(const unsigned char* in) {
+    return (((unsigned int)in[0]) << 24) | (((unsigned int)in[1]) << 16) |
+           (((unsigned int)in[2]) << 8) | ((unsigned int)in[3]);
+  }
+};
+
+/* bounds-check level */
+
+/** Every read and write is validated; the only level for untrusted input */
+struct ValidatedInput {
+  static constexpr bool kTrusted = false;
+};
+
+/**
+ * Input produced by our own encoder and protected by its checksum. The
+ * symbol loop skips the per-read error checks while there is enough input
+ * and output slack left for any symbol, and never writes out of bounds.
+ */
+struct TrustedInput {
+  static constexpr bool kTrusted = true;
+};
+
+/* output */
+
+/** Decode straight into the caller's buffer, which must hold the whole
+ * output */
+struct BufferOutput {
+  static constexpr bool kWindowed = false;
+};
+
+/* instrumentation */
+
+struct NoInstrumentation {
+  static constexpr bool kEnabled = false;
+
+  static void Count(BitReader*, unsigned long long InflateStats::*,
+                    unsigned long long) {}
+  static unsigned long long Now() { return 0; }
+  static void PhaseBegin(BitReader*, InflatePhase) {}
+  static void PhaseEnd(BitReader*, InflatePhase) {}
+};
+
+#ifdef INFLATECPP_ENABLE_STATS
+struct CountingInstrumentation {
+  static constexpr bool kEnabled = true;
+
+  static void Count(BitReader* bit_reader,
+                    unsigned long long InflateStats::*counter,
+                    unsigned long long n) {
+    InflateStats* stats = bit_reader->GetStats();
+    if (stats) stats->*counter += n;
+  }
+  /** Monotonic time in nanoseconds */
+  static unsigned long long Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+  static void PhaseBegin(BitReader* bit_reader, InflatePhase phase) {
+    InflatePhaseObserver* observer = bit_reader->GetPhaseObserver();
+    if (observer) observer->OnPhaseBegin(phase);
+  }
+  static void PhaseEnd(BitReader* bit_reader, InflatePhase phase) {
+    InflatePhaseObserver* observer = bit_reader->GetPhaseObserver();
+    if (observer) observer->OnPhaseEnd(phase);
+  }
+};
+
+typedef CountingInstrumentation DefaultInstrumentation;
+#else
+typedef NoInstrumentation DefaultInstrumentation;
+#endif /* INFLATECPP_ENABLE_STATS */
+
+#endif /* !_INFLATE_POLICIES_H */
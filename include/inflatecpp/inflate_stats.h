@@ -0,0 +1,89 @@
+#ifndef _INFLATE_STATS_H
+#define _INFLATE_STATS_H
+
+/*-- optional hot-path instrumentation --*/
+
+/**
+ * Counters are only collected when INFLATECPP_ENABLE_STATS is defined before
+ * the first inflatecpp header is included. Otherwise every INFLATE_STATS_*
+ * macro expands to nothing, its arguments are never evaluated, the block
+ * decoder is instantiated with NoInstrumentation (see inflate_policies.h),
+ * and the decoder compiles to exactly the same code as without
+ * instrumentation.
+ */
+
+#ifdef INFLATECPP_ENABLE_STATS
+#include <chrono>
+#endif /* INFLATECPP_ENABLE_STATS */
+
+struct InflateStats {
+  /* blocks, by type */
+  unsigned long long stored_blocks;
+  unsigned long long fixed_blocks;
+  unsigned long long dynamic_blocks;
+
+  /* time spent reading code lengths and building dynamic block tables */
+  unsigned long long dynamic_table_ns;
+
+  /* blocks whose decoder tables came from, or went into, the table cache */
+  unsigned long long table_cache_hits;
+  unsigned long long table_cache_misses;
+
+  /* HuffmanDecoder::ReadValue */
+  unsigned long long fast_symbol_hits;
+  unsigned long long slow_path_symbols;
+  unsigned long long slow_path_iterations;
+
+  /* decoded symbols */
+  unsigned long long literals;
+  unsigned long long matches;
+  unsigned long long match_bytes;
+
+  /* matches copied byte by byte, because of a short offset or the output end */
+  unsigned long long short_offset_copies;
+
+  /* 32-bit refills by Refill32(), byte refills by GetBits()/PeekBits() */
+  unsigned long long refills;
+  unsigned long long byte_refills;
+
+  unsigned long long stored_bytes;
+};
+
+enum class InflatePhase {
+  kHeader = 0,     /* stream, block and code length headers */
+  kTableBuild = 1, /* PrepareTable()/FinalizeTable() */
+  kSymbolLoop = 2, /* symbol decoding, match and stored copies */
+  kChecksum = 3,   /* Adler-32/CRC32 update and trailer check */
+};
+constexpr int kInflatePhases = 4;
+
+/**
+ * Notified at decode phase boundaries, e.g. to sample hardware counters.
+ * Phases never nest; a failed decode may leave the last phase without its
+ * OnPhaseEnd().
+ */
+class InflatePhaseObserver {
+ public:
+  virtual ~InflatePhaseObserver() = default;
+
+  virtual void OnPhaseBegin(InflatePhase) = 0;
+  virtual void OnPhaseEnd(InflatePhase) = 0;
+};
+
+#ifdef INFLATECPP_ENABLE_STATS
+constexpr bool kInflateStatsEnabled = true;
+
+#define INFLATE_STATS_ADD(__bit_reader, __field, __n)   \
+  do {                                                  \
+    InflateStats* __stats = (__bit_reader)->GetStats(); \
+    if (__stats) __stats->__field += (__n);             \
+  } while (0)
+#else
+constexpr bool kInflateStatsEnabled = false;
+
+#define INFLATE_STATS_ADD(__bit_reader, __field, __n) \
+  do {                                                \
+  } while (0)
+#endif /* INFLATECPP_ENABLE_STATS */
+
+#endif /* !_INFLATE_STATS_H */
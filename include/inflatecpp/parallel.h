@@ -0,0 +1,43 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/*-- work sharing across threads --*/
+
+/**
+ * Run function(index, &state) for every index below count, across a pool of
+ * threads. Each worker default-constructs its own State, e.g. a
+ * Decompressor and so its own decoder table cache, and takes the next index
+ * as soon as it is done with one, so that a few large items do not hold up
+ * the others. The calling thread is one of the workers.
+ *
+ * @tparam State per-worker state
+ * @param count number of items
+ * @param threads number of threads; 0 for one per hardware thread
+ * @param function callable taking (size_t, State*)
+ */
+template <class State, class Function>
+void ParallelForEach(size_t count, unsigned int threads,
+                     const Function& function) {
+  if (!threads) threads = std::max(1U, std::thread::hardware_concurrency());
+  if (threads > count) threads = (unsigned int)count;
+  if (!threads) return;
+
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    State state;
+    for (size_t i = next++; i < count; i = next++) function(i, &state);
+  };
+
+  auto pool = std::vector<std::thread>{};
+  for (unsigned int i = 1; i < threads; i++) pool.emplace_back(worker);
+  worker();
+  for (auto& thread : pool) thread.join();
+}
+
+#endif /* !_PARALLEL_H */
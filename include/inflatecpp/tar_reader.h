@@ -0,0 +1,498 @@
+#ifndef _TAR_READER_H
+#define _TAR_READER_H
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "decompressor.h"
+
+/*-- tar.gz archive reader --*/
+
+constexpr auto kTarBlockSize = 512;
+
+/* extended header types, from the typeflag of the header */
+constexpr char kTarGnuLongName = 'L';
+constexpr char kTarPaxHeader = 'x';
+constexpr char kTarPaxGlobalHeader = 'g';
+
+/* long names and pax records are read into memory; anything larger is not
+ * a header */
+constexpr size_t kTarMaxExtendedHeader = 1 << 20;
+/* largest member size that can be padded to whole blocks, in a long long
+ * and in a size_t */
+constexpr unsigned long long kTarMaxMemberSize =
+    std::min((unsigned long long)LLONG_MAX, (unsigned long long)SIZE_MAX) -
+    kTarBlockSize;
+
+/* default distance between checkpoints, in decompressed bytes */
+constexpr size_t kTarCheckpointSpacing = 1 << 20;
+
+/** Member of a tar archive */
+struct TarMember {
+  std::string name;
+  char type;
+  /* offset of the member's data in the decompressed archive */
+  size_t offset;
+  size_t size;
+};
+
+/**
+ * Parses a tar archive from its decompressed bytes as they stream out of
+ * the decoder. Headers are gathered 512 bytes at a time; member data is
+ * only counted, so that it never leaves the decoder's rolling window.
+ */
+class TarIndexer : public InflateStreamObserver {
+ public:
+  TarIndexer(std::vector<TarMember>* members,
+             std::vector<InflateCheckpoint>* checkpoints,
+             size_t checkpoint_spacing)
+      : members_(members),
+        checkpoints_(checkpoints),
+        checkpoint_spacing_(checkpoint_spacing){};
+
+  void OnData(const unsigned char*, size_t) override;
+  bool OnBlockBoundary(const InflateBlockBoundary&) override;
+
+  /** True if a header was malformed or the archive ends within a member */
+  bool Failed() const {
+    return this->failed_ || this->skip_size_ || !this->header_.empty();
+  };
+
+ private:
+  std::vector<TarMember>* members_;
+  std::vector<InflateCheckpoint>* checkpoints_;
+  size_t checkpoint_spacing_;
+
+  /* decompressed bytes seen */
+  size_t offset_ = 0;
+  /* header being gathered, or extended header being read */
+  std::vector<unsigned char> header_;
+  size_t header_size_ = kTarBlockSize;
+  bool in_extended_header_ = false;
+  char extended_type_ = 0;
+  /* member data and padding left to skip */
+  size_t skip_size_ = 0;
+  /* name and size overrides of the next member, from extended headers */
+  std::string next_name_;
+  long long next_size_ = -1;
+  /* whether a member started since the last checkpoint, and where the last
+   * checkpoint is */
+  bool has_header_since_checkpoint_ = true;
+  size_t last_checkpoint_offset_ = 0;
+  bool failed_ = false;
+  bool ended_ = false;
+
+  void OnHeader(const unsigned char*);
+  void OnExtendedHeader(const unsigned char*, size_t);
+};
+
+/**
+ * Read-only view of a gzip-compressed tar archive. Opening it decodes the
+ * archive once, in constant memory, to index its members and optionally
+ * record checkpoints along the way; extracting a member later resumes
+ * decoding at the last checkpoint before it instead of at the start.
+ */
+class TarGzReader {
+ public:
+  TarGzReader(){};
+  ~TarGzReader() = default;
+
+  int Open(const void*, size_t, size_t = kTarCheckpointSpacing);
+
+  size_t GetMemberCount() const { return this->members_.size(); };
+  const TarMember& GetMember(size_t index) const {
+    return this->members_[index];
+  };
+  const TarMember* FindMember(const std::string&) const;
+  size_t GetCheckpointCount() const { return this->checkpoints_.size(); };
+
+  InflateResult Extract(const TarMember&, unsigned char*, size_t);
+  InflateResult Extract(const TarMember&, std::vector<unsigned char>*);
+
+ private:
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+  Decompressor decompressor_;
+  std::vector<TarMember> members_;
+  /* member index by name; the last of duplicate names wins, as tar does */
+  std::unordered_map<std::string, size_t> index_;
+  /* in order of out_offset */
+  std::vector<InflateCheckpoint> checkpoints_;
+};
+
+/**
+ * Read a numeric header field: octal digits, or big-endian base-256 when
+ * its first byte has the high bit set, for sizes of 8 GB and more
+ *
+ * @param field start of the field
+ * @param size size of the field, in bytes
+ *
+ * @return value, or -1 if it is malformed
+ */
+long long ReadTarNumber(const unsigned char* field, int size) {
+  unsigned long long value = 0;
+
+  if (field[0] & 0x80) {
+    if (field[0] != 0x80) return -1; /* negative, or too large */
+    for (int i = 1; i < size; i++) {
+      if (value >> 55) return -1;
+      value = (value << 8) | field[i];
+    }
+    return (long long)value;
+  }
+
+  int i = 0;
+  while (i < size && field[i] == ' ') i++;
+  for (; i < size && field[i] >= '0' && field[i] <= '7'; i++) {
+    if (value >> 60) return -1;
+    value = (value << 3) | (field[i] - '0');
+  }
+  if (i < size && field[i] != ' ' && field[i] != '\0') return -1;
+  return (long long)value;
+}
+
+/**
+ * Read a NUL-padded header string
+ *
+ * @param field start of the field
+ * @param size size of the field, in bytes
+ *
+ * @return string, up to its first NUL
+ */
+std::string ReadTarString(const unsigned char* field, int size) {
+  const unsigned char* end = (const unsigned char*)std::memchr(field, 0, size);
+  return std::string{(const char*)field,
+                     end ? (size_t)(end - field) : (size_t)size};
+}
+
+/**
+ * Consume decompressed bytes: gather headers, skip member data
+ *
+ * @param data decompressed bytes
+ * @param size number of bytes
+ */
+void TarIndexer::OnData(const unsigned char* data, size_t size) {
+  while (size && !this->failed_ && !this->ended_) {
+    if (this->skip_size_) {
+      size_t length = std::min(size, this->skip_size_);
+      this->skip_size_ -= length;
+      this->offset_ += length;
+      data += length;
+      size -= length;
+      continue;
+    }
+
+    size_t length =
+        std::min(size, this->header_size_ - this->header_.size());
+    this->header_.insert(this->header_.end(), data, data + length);
+    this->offset_ += length;
+    data += length;
+    size -= length;
+
+    if (this->header_.size() < this->header_size_) continue;
+
+    if (this->in_extended_header_) {
+      this->OnExtendedHeader(this->header_.data(), this->header_.size());
+      this->in_extended_header_ = false;
+    } else {
+      this->OnHeader(this->header_.data());
+    }
+    this->header_.clear();
+  }
+
+  this->offset_ += size;
+}
+
+/**
+ * Parse a complete 512-byte header, and set up skipping or reading what
+ * follows it
+ *
+ * @param header header block
+ */
+void TarIndexer::OnHeader(const unsigned char* header) {
+  /* an all-zero block ends the archive */
+  if (std::all_of(header, header + kTarBlockSize,
+                  [](unsigned char c) { return c == 0; })) {
+    this->ended_ = true;
+    return;
+  }
+
+  /* the checksum is computed with its own field as spaces */
+  long long stored_checksum = ReadTarNumber(header + 148, 8);
+  long long checksum = 8 * ' ';
+  for (int i = 0; i < kTarBlockSize; i++)
+    if (i < 148 || i >= 156) checksum += header[i];
+  if (stored_checksum != checksum) {
+    this->failed_ = true;
+    return;
+  }
+
+  long long size = ReadTarNumber(header + 124, 12);
+  if (size < 0 || (unsigned long long)size > kTarMaxMemberSize) {
+    this->failed_ = true;
+    return;
+  }
+
+  char type = (char)header[156];
+  size_t padded_size =
+      (size_t)(size + kTarBlockSize - 1) & ~(size_t)(kTarBlockSize - 1);
+
+  if (type == kTarGnuLongName || type == kTarPaxHeader ||
+      type == kTarPaxGlobalHeader) {
+    if ((size_t)size > kTarMaxExtendedHeader) {
+      this->failed_ = true;
+      return;
+    }
+    this->in_extended_header_ = true;
+    this->extended_type_ = type;
+    this->header_size_ = padded_size;
+    /* an empty extended header is complete already */
+    if (!padded_size) {
+      this->in_extended_header_ = false;
+      this->header_size_ = kTarBlockSize;
+    }
+    return;
+  }
+
+  if (this->next_size_ >= 0) size = this->next_size_;
+  if ((unsigned long long)size > kTarMaxMemberSize) {
+    this->failed_ = true;
+    return;
+  }
+  padded_size =
+      (size_t)(size + kTarBlockSize - 1) & ~(size_t)(kTarBlockSize - 1);
+
+  auto member = TarMember{};
+  if (!this->next_name_.empty()) {
+    member.name = this->next_name_;
+  } else {
+    member.name = ReadTarString(header, 100);
+    /* POSIX ustar splits long names into a prefix and a name; GNU tar puts
+     * other fields there, and its magic ends with a space instead */
+    if (!std::memcmp(header + 257, "ustar", 6) && header[345]) {
+      member.name = ReadTarString(header + 345, 155) + "/" + member.name;
+    }
+  }
+  member.type = type;
+  member.offset = this->offset_;
+  member.size = (size_t)size;
+  this->members_->push_back(member);
+
+  this->next_name_.clear();
+  this->next_size_ = -1;
+  this->skip_size_ = padded_size;
+  this->has_header_since_checkpoint_ = true;
+}
+
+/**
+ * Apply a GNU long name or the path and size records of a pax header to
+ * the next member
+ *
+ * @param data contents of the extended header, padded to 512 bytes
+ * @param size padded size, in bytes
+ */
+void TarIndexer::OnExtendedHeader(const unsigned char* data, size_t size) {
+  this->header_size_ = kTarBlockSize;
+
+  if (this->extended_type_ == kTarGnuLongName) {
+    this->next_name_ = ReadTarString(data, (int)size);
+    return;
+  }
+  /* global headers apply to every later member; only per-member ones are
+   * honoured */
+  if (this->extended_type_ != kTarPaxHeader) return;
+
+  /* records are "<length> <key>=<value>\n" */
+  size_t position = 0;
+  while (position < size && data[position]) {
+    size_t length = 0;
+    size_t i = position;
+    while (i < size && data[i] >= '0' && data[i] <= '9')
+      length = length * 10 + (data[i++] - '0');
+    if (i >= size || data[i] != ' ' || length < i - position + 2 ||
+        length > size - position) {
+      this->failed_ = true;
+      return;
+    }
+
+    std::string record{(const char*)data + i + 1,
+                       position + length - 1 - (i + 1)};
+    size_t equals = record.find('=');
+    if (equals != std::string::npos) {
+      std::string key = record.substr(0, equals);
+      std::string value = record.substr(equals + 1);
+      if (key == "path") {
+        this->next_name_ = value;
+      } else if (key == "size") {
+        this->next_size_ = std::strtoll(value.c_str(), nullptr, 10);
+        if (this->next_size_ < 0) this->failed_ = true;
+      }
+    }
+    position += length;
+  }
+}
+
+/**
+ * Record a checkpoint at this boundary if a member header was seen since
+ * the last one, and the last one is far enough back
+ *
+ * @param boundary block boundary
+ *
+ * @return false to stop decoding, at the end of the archive
+ */
+bool TarIndexer::OnBlockBoundary(const InflateBlockBoundary& boundary) {
+  if (this->failed_ || this->ended_) return false;
+
+  if (this->checkpoint_spacing_ && this->has_header_since_checkpoint_ &&
+      (this->checkpoints_->empty() ||
+       this->offset_ - this->last_checkpoint_offset_ >=
+           this->checkpoint_spacing_)) {
+    this->checkpoints_->push_back(
+        MakeInflateCheckpoint(boundary, this->offset_));
+    this->last_checkpoint_offset_ = this->offset_;
+    this->has_header_since_checkpoint_ = false;
+  }
+  return true;
+}
+
+/**
+ * Index an archive in memory
+ *
+ * @param data pointer to start of the gzip data; must outlive the reader
+ * @param size size of the gzip data, in bytes
+ * @param checkpoint_spacing minimum distance between checkpoints, in
+ * decompressed bytes; 0 to record none, so that every extraction decodes
+ * from the start
+ *
+ * @return 0 for success, -1 for failure
+ */
+int TarGzReader::Open(const void* data, size_t size,
+                      size_t checkpoint_spacing) {
+  this->data_ = (const unsigned char*)data;
+  this->size_ = size;
+  this->members_.clear();
+  this->index_.clear();
+  this->checkpoints_.clear();
+
+  TarIndexer indexer{&this->members_, &this->checkpoints_,
+                     checkpoint_spacing};
+  /* the indexer stops at the end-of-archive blocks, so the trailer is only
+   * verified for archives without them */
+  InflateResult result =
+      this->decompressor_.FeedStreaming(data, size, &indexer, true);
+  if (!result.Ok() || indexer.Failed()) {
+    this->members_.clear();
+    this->checkpoints_.clear();
+    return -1;
+  }
+
+  for (size_t i = 0; i < this->members_.size(); i++)
+    this->index_[this->members_[i].name] = i;
+  return 0;
+}
+
+/**
+ * Look up a member by name
+ *
+ * @param name name of the member, as stored in the archive
+ *
+ * @return member, or nullptr if there is none by that name
+ */
+const TarMember* TarGzReader::FindMember(const std::string& name) const {
+  auto found = this->index_.find(name);
+  if (found == this->index_.end()) return nullptr;
+  return &this->members_[found->second];
+}
+
+/** Copies one range of a resumed stream out, and stops once it is done */
+class TarRangeCopier : public InflateStreamObserver {
+ public:
+  TarRangeCopier(size_t offset, size_t start, unsigned char* out, size_t size)
+      : offset_(offset), start_(start), out_(out), size_(size){};
+
+  void OnData(const unsigned char* data, size_t size) override {
+    size_t end = this->offset_ + size;
+    size_t copy_start = std::max(this->offset_, this->start_);
+    size_t copy_end = std::min(end, this->start_ + this->size_);
+    if (copy_start < copy_end) {
+      std::memcpy(this->out_ + (copy_start - this->start_),
+                  data + (copy_start - this->offset_), copy_end - copy_start);
+      this->copied_ += copy_end - copy_start;
+    }
+    this->offset_ = end;
+  };
+  bool OnBlockBoundary(const InflateBlockBoundary&) override {
+    return this->copied_ < this->size_;
+  };
+
+  size_t GetCopied() const { return this->copied_; };
+
+ private:
+  /* offset of the next byte in the decompressed archive */
+  size_t offset_;
+  size_t start_;
+  unsigned char* out_;
+  size_t size_;
+  size_t copied_ = 0;
+};
+
+/**
+ * Decompress a member, resuming at the last checkpoint before it
+ *
+ * @param member member of this archive
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes; the
+ * member's size is always enough
+ *
+ * @return status and number of bytes decompressed. The archive's CRC32 is
+ * not verified; it covers more than the member.
+ */
+InflateResult TarGzReader::Extract(const TarMember& member, unsigned char* out,
+                                   size_t out_size_max) {
+  if (member.size > out_size_max) return {InflateStatus::kDataError, 0};
+  if (!member.size) return {InflateStatus::kOk, 0};
+
+  auto checkpoint = std::upper_bound(
+      this->checkpoints_.begin(), this->checkpoints_.end(), member.offset,
+      [](size_t offset, const InflateCheckpoint& checkpoint) {
+        return offset < checkpoint.out_offset;
+      });
+
+  bool from_start = checkpoint == this->checkpoints_.begin();
+  if (!from_start) --checkpoint;
+
+  TarRangeCopier copier{from_start ? 0 : checkpoint->out_offset,
+                        member.offset, out, member.size};
+  InflateResult result =
+      from_start ? this->decompressor_.FeedStreaming(this->data_, this->size_,
+                                                     &copier, false)
+                 : this->decompressor_.ResumeStreaming(
+                       this->data_, this->size_, *checkpoint, &copier);
+
+  if (!result.Ok()) return result;
+  if (copier.GetCopied() != member.size) return {InflateStatus::kDataError, 0};
+  return {InflateStatus::kOk, member.size};
+}
+
+/**
+ * Decompress a member into a vector sized for it
+ *
+ * @param member member of this archive
+ * @param out receives the decompressed member
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult TarGzReader::Extract(const TarMember& member,
+                                   std::vector<unsigned char>* out) {
+  out->resize(member.size);
+  InflateResult result = this->Extract(member, out->data(), out->size());
+  if (!result.Ok()) out->clear();
+  return result;
+}
+
+#endif /* !_TAR_READER_H */
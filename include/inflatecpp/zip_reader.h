@@ -0,0 +1,512 @@
+#ifndef _ZIP_READER_H
+#define _ZIP_READER_H
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define INFLATECPP_ZIP_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* unix */
+
+#include "decompressor.h"
+#include "parallel.h"
+
+/*-- ZIP/JAR archive reader --*/
+
+constexpr unsigned int kZipLocalHeaderSig = 0x04034b50;
+constexpr unsigned int kZipCentralHeaderSig = 0x02014b50;
+constexpr unsigned int kZipEndSig = 0x06054b50;
+constexpr unsigned int kZip64EndSig = 0x06064b50;
+constexpr unsigned int kZip64LocatorSig = 0x07064b50;
+
+constexpr auto kZipLocalHeaderSize = 30;
+constexpr auto kZipCentralHeaderSize = 46;
+constexpr auto kZipEndSize = 22;
+constexpr auto kZip64EndSize = 56;
+constexpr auto kZip64LocatorSize = 20;
+/* the end record may be followed by a comment of up to 64 KB */
+constexpr auto kZipMaxCommentSize = 0xffff;
+
+constexpr unsigned short kZipStored = 0;
+constexpr unsigned short kZipDeflated = 8;
+constexpr unsigned short kZip64ExtraId = 0x0001;
+constexpr unsigned short kZipEncryptedFlag = 0x0001;
+
+/* deflate expands at most 1032 times, plus a match of 258 bytes at the
+ * end */
+constexpr unsigned long long kZipMaxDeflateRatio = 1032;
+constexpr unsigned long long kZipMaxDeflateExtra = 258;
+
+/** Entry of the central directory */
+struct ZipEntry {
+  std::string name;
+  unsigned short method;
+  unsigned short flags;
+  unsigned int crc32;
+  size_t compressed_size;
+  size_t uncompressed_size;
+  size_t local_header_offset;
+};
+
+/**
+ * Read-only view of a ZIP archive. Opening it only parses the central
+ * directory, from a memory-mapped file where available, into a name index;
+ * entries are decoded on demand, one at a time or many in parallel. ZIP64
+ * archives are supported; spanned and encrypted ones are not.
+ */
+class ZipReader {
+ public:
+  ZipReader(){};
+  ~ZipReader();
+
+  ZipReader(const ZipReader&) = delete;
+  ZipReader& operator=(const ZipReader&) = delete;
+
+  int Open(const char*);
+  int OpenMemory(const void*, size_t);
+  void Close();
+
+  size_t GetEntryCount() const { return this->entries_.size(); };
+  const ZipEntry& GetEntry(size_t index) const {
+    return this->entries_[index];
+  };
+  const ZipEntry* FindEntry(const std::string&) const;
+
+  InflateResult Extract(const ZipEntry&, unsigned char*, size_t,
+                        Decompressor*) const;
+  InflateResult Extract(const ZipEntry&, std::vector<unsigned char>*,
+                        Decompressor*) const;
+  std::vector<InflateResult> ExtractParallel(
+      const std::vector<const ZipEntry*>&,
+      std::vector<std::vector<unsigned char>>*, unsigned int) const;
+
+ private:
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+  /* mapping of Open(), or its copy where mmap is unavailable */
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  std::unique_ptr<unsigned char[]> buffer_;
+
+  std::vector<ZipEntry> entries_;
+  /* entry index by name; the first of duplicate names wins */
+  std::unordered_map<std::string, size_t> index_;
+
+  int ReadCentralDirectory();
+  int ReadEntry(const unsigned char*, const unsigned char*, ZipEntry*,
+                size_t*);
+  const unsigned char* LocateData(const ZipEntry&) const;
+};
+
+unsigned short ReadZipLe16(const unsigned char* in) {
+  return ((unsigned short)in[0]) | (((unsigned short)in[1]) << 8);
+}
+
+unsigned int ReadZipLe32(const unsigned char* in) {
+  return ((unsigned int)in[0]) | (((unsigned int)in[1]) << 8) |
+         (((unsigned int)in[2]) << 16) | (((unsigned int)in[3]) << 24);
+}
+
+unsigned long long ReadZipLe64(const unsigned char* in) {
+  return ((unsigned long long)ReadZipLe32(in)) |
+         (((unsigned long long)ReadZipLe32(in + 4)) << 32);
+}
+
+ZipReader::~ZipReader() { this->Close(); }
+
+/**
+ * Open an archive file and index its central directory
+ *
+ * @param path path of the archive
+ *
+ * @return 0 for success, -1 for failure
+ */
+int ZipReader::Open(const char* path) {
+  this->Close();
+
+#ifdef INFLATECPP_ZIP_MMAP
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) return -1;
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0 || st.st_size <= 0) {
+    ::close(fd);
+    return -1;
+  }
+
+  void* mapping =
+      ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) return -1;
+
+  this->mapping_ = mapping;
+  this->mapping_size_ = (size_t)st.st_size;
+  this->data_ = (const unsigned char*)mapping;
+  this->size_ = (size_t)st.st_size;
+#else
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) return -1;
+
+  auto size = file.tellg();
+  if (size <= 0) return -1;
+  file.seekg(0, std::ios::beg);
+
+  this->buffer_.reset(new unsigned char[(size_t)size]);
+  if (!file.read(reinterpret_cast<char*>(this->buffer_.get()), size)) {
+    this->buffer_.reset();
+    return -1;
+  }
+
+  this->data_ = this->buffer_.get();
+  this->size_ = (size_t)size;
+#endif /* INFLATECPP_ZIP_MMAP */
+
+  if (this->ReadCentralDirectory() < 0) {
+    this->Close();
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Index the central directory of an archive already in memory
+ *
+ * @param data pointer to start of the archive; must outlive the reader
+ * @param size size of the archive, in bytes
+ *
+ * @return 0 for success, -1 for failure
+ */
+int ZipReader::OpenMemory(const void* data, size_t size) {
+  this->Close();
+
+  this->data_ = (const unsigned char*)data;
+  this->size_ = size;
+
+  if (this->ReadCentralDirectory() < 0) {
+    this->Close();
+    return -1;
+  }
+  return 0;
+}
+
+/** Release the archive and its index */
+void ZipReader::Close() {
+#ifdef INFLATECPP_ZIP_MMAP
+  if (this->mapping_) ::munmap(this->mapping_, this->mapping_size_);
+#endif /* INFLATECPP_ZIP_MMAP */
+  this->mapping_ = nullptr;
+  this->mapping_size_ = 0;
+  this->buffer_.reset();
+
+  this->data_ = nullptr;
+  this->size_ = 0;
+  this->entries_.clear();
+  this->index_.clear();
+}
+
+/**
+ * Look up an entry by name
+ *
+ * @param name full name of the entry in the archive, '/'-separated
+ *
+ * @return entry, or nullptr if there is none by that name
+ */
+const ZipEntry* ZipReader::FindEntry(const std::string& name) const {
+  auto found = this->index_.find(name);
+  if (found == this->index_.end()) return nullptr;
+  return &this->entries_[found->second];
+}
+
+/**
+ * Locate the end of central directory record, and the ZIP64 one if the
+ * archive needs it, then read every central directory entry
+ *
+ * @return 0 for success, -1 for failure
+ */
+int ZipReader::ReadCentralDirectory() {
+  if (this->size_ < kZipEndSize) return -1;
+
+  /* the end record is the last signature that leaves room for itself; scan
+   * back over the comment for it */
+  const unsigned char* start = this->data_;
+  const unsigned char* end = this->data_ + this->size_;
+  size_t scan_size = std::min<size_t>(this->size_ - kZipEndSize,
+                                      kZipMaxCommentSize);
+  const unsigned char* eocd = nullptr;
+
+  for (size_t i = 0; i <= scan_size; i++) {
+    const unsigned char* p = end - kZipEndSize - i;
+    if (ReadZipLe32(p) == kZipEndSig && ReadZipLe16(p + 20) <= i) {
+      eocd = p;
+      break;
+    }
+  }
+  if (!eocd) return -1;
+
+  unsigned long long entry_count = ReadZipLe16(eocd + 10);
+  unsigned long long directory_size = ReadZipLe32(eocd + 12);
+  unsigned long long directory_offset = ReadZipLe32(eocd + 16);
+
+  /* a ZIP64 end record is located by the locator just before this one */
+  if (eocd - start >= kZip64LocatorSize &&
+      ReadZipLe32(eocd - kZip64LocatorSize) == kZip64LocatorSig) {
+    unsigned long long zip64_offset = ReadZipLe64(eocd - kZip64LocatorSize + 8);
+    if (this->size_ < kZip64EndSize ||
+        zip64_offset > this->size_ - kZip64EndSize)
+      return -1;
+
+    const unsigned char* zip64_eocd = start + zip64_offset;
+    if (ReadZipLe32(zip64_eocd) != kZip64EndSig) return -1;
+
+    entry_count = ReadZipLe64(zip64_eocd + 32);
+    directory_size = ReadZipLe64(zip64_eocd + 40);
+    directory_offset = ReadZipLe64(zip64_eocd + 48);
+  }
+
+  if (directory_offset > this->size_ ||
+      directory_size > this->size_ - directory_offset)
+    return -1;
+  /* each entry takes at least a fixed-size header */
+  if (entry_count > directory_size / kZipCentralHeaderSize) return -1;
+
+  const unsigned char* current = start + directory_offset;
+  const unsigned char* directory_end = current + directory_size;
+
+  this->entries_.resize((size_t)entry_count);
+  this->index_.reserve((size_t)entry_count);
+
+  for (size_t i = 0; i < this->entries_.size(); i++) {
+    size_t header_size;
+    if (this->ReadEntry(current, directory_end, &this->entries_[i],
+                        &header_size) < 0)
+      return -1;
+    current += header_size;
+
+    this->index_.emplace(this->entries_[i].name, i);
+  }
+
+  return 0;
+}
+
+/**
+ * Read one central directory entry, with its ZIP64 extra field if any
+ *
+ * @param header pointer to start of the entry
+ * @param directory_end end of the central directory
+ * @param entry receives the entry
+ * @param header_size receives the size of the entry in the directory
+ *
+ * @return 0 for success, -1 for failure
+ */
+int ZipReader::ReadEntry(const unsigned char* header,
+                         const unsigned char* directory_end, ZipEntry* entry,
+                         size_t* header_size) {
+  if (directory_end - header < kZipCentralHeaderSize ||
+      ReadZipLe32(header) != kZipCentralHeaderSig)
+    return -1;
+
+  unsigned short name_size = ReadZipLe16(header + 28);
+  unsigned short extra_size = ReadZipLe16(header + 30);
+  unsigned short comment_size = ReadZipLe16(header + 32);
+
+  *header_size =
+      (size_t)kZipCentralHeaderSize + name_size + extra_size + comment_size;
+  if ((size_t)(directory_end - header) < *header_size) return -1;
+
+  entry->flags = ReadZipLe16(header + 8);
+  entry->method = ReadZipLe16(header + 10);
+  entry->crc32 = ReadZipLe32(header + 16);
+
+  unsigned long long compressed_size = ReadZipLe32(header + 20);
+  unsigned long long uncompressed_size = ReadZipLe32(header + 24);
+  unsigned long long local_header_offset = ReadZipLe32(header + 42);
+
+  const unsigned char* name = header + kZipCentralHeaderSize;
+  entry->name.assign((const char*)name, name_size);
+
+  /* The ZIP64 extra field holds, in this order, only those of the sizes and
+   * the offset whose 32-bit field is saturated */
+  const unsigned char* extra = name + name_size;
+  const unsigned char* extra_end = extra + extra_size;
+
+  while (extra_end - extra >= 4) {
+    unsigned short id = ReadZipLe16(extra);
+    unsigned short size = ReadZipLe16(extra + 2);
+    extra += 4;
+    if (extra_end - extra < size) return -1;
+
+    if (id == kZip64ExtraId) {
+      const unsigned char* field = extra;
+      const unsigned char* field_end = extra + size;
+
+      for (unsigned long long* value :
+           {&uncompressed_size, &compressed_size, &local_header_offset}) {
+        if (*value != 0xffffffff) continue;
+        if (field_end - field < 8) return -1;
+        *value = ReadZipLe64(field);
+        field += 8;
+      }
+    }
+    extra += size;
+  }
+
+  if (local_header_offset > this->size_ ||
+      compressed_size > this->size_ - local_header_offset ||
+      uncompressed_size > (size_t)-1)
+    return -1;
+
+  /* the uncompressed size is allocated before decoding: bound it by what
+   * the compressed data can produce */
+  if (!(entry->flags & kZipEncryptedFlag)) {
+    if (entry->method == kZipStored && uncompressed_size != compressed_size)
+      return -1;
+    if (entry->method == kZipDeflated &&
+        uncompressed_size >
+            compressed_size * kZipMaxDeflateRatio + kZipMaxDeflateExtra)
+      return -1;
+  }
+
+  entry->compressed_size = (size_t)compressed_size;
+  entry->uncompressed_size = (size_t)uncompressed_size;
+  entry->local_header_offset = (size_t)local_header_offset;
+
+  return 0;
+}
+
+/**
+ * Locate the data of an entry, after its local header
+ *
+ * @param entry entry of this archive
+ *
+ * @return pointer to the compressed data, or nullptr if the local header is
+ * invalid or the data does not fit in the archive
+ */
+const unsigned char* ZipReader::LocateData(const ZipEntry& entry) const {
+  size_t offset = entry.local_header_offset;
+  if (this->size_ - offset < kZipLocalHeaderSize) return nullptr;
+
+  const unsigned char* header = this->data_ + offset;
+  if (ReadZipLe32(header) != kZipLocalHeaderSig) return nullptr;
+
+  /* the local name and extra field may differ from the central ones */
+  offset += (size_t)kZipLocalHeaderSize + ReadZipLe16(header + 26) +
+            ReadZipLe16(header + 28);
+  if (offset > this->size_ ||
+      entry.compressed_size > this->size_ - offset)
+    return nullptr;
+
+  return this->data_ + offset;
+}
+
+/**
+ * Decompress an entry and verify its CRC32
+ *
+ * @param entry entry of this archive
+ * @param out pointer to start of decompression buffer
+ * @param out_size_max maximum size of decompression buffer, in bytes; the
+ * entry's uncompressed_size is always enough
+ * @param decompressor decompressor to use; one per thread
+ *
+ * @return status and number of bytes decompressed. Unsupported compression
+ * methods and encrypted entries are reported as kDataError.
+ */
+InflateResult ZipReader::Extract(const ZipEntry& entry, unsigned char* out,
+                                 size_t out_size_max,
+                                 Decompressor* decompressor) const {
+  if (entry.flags & kZipEncryptedFlag) return {InflateStatus::kDataError, 0};
+
+  const unsigned char* data = this->LocateData(entry);
+  if (!data) return {InflateStatus::kDataError, 0};
+
+  InflateResult result;
+  switch (entry.method) {
+    case kZipStored:
+      if (entry.compressed_size > out_size_max)
+        return {InflateStatus::kDataError, 0};
+      if (entry.compressed_size)
+        std::memcpy(out, data, entry.compressed_size);
+      result = {InflateStatus::kOk, entry.compressed_size};
+      break;
+
+    case kZipDeflated:
+      result = decompressor->FeedRaw(data, entry.compressed_size, out,
+                                     out_size_max);
+      if (!result.Ok()) return result;
+      break;
+
+    default:
+      return {InflateStatus::kDataError, 0};
+  }
+
+  if (result.size != entry.uncompressed_size)
+    return {InflateStatus::kDataError, 0};
+  if (Crc32Checksum::Update(Crc32Checksum::Init(), out, result.size) !=
+      entry.crc32)
+    return {InflateStatus::kChecksumMismatch, 0};
+
+  return result;
+}
+
+/**
+ * Decompress an entry into a vector sized for it
+ *
+ * @param entry entry of this archive
+ * @param out receives the decompressed entry
+ * @param decompressor decompressor to use; one per thread
+ *
+ * @return status and number of bytes decompressed
+ */
+InflateResult ZipReader::Extract(const ZipEntry& entry,
+                                 std::vector<unsigned char>* out,
+                                 Decompressor* decompressor) const {
+  /* only the sizes of entries that can be extracted are checked */
+  if ((entry.flags & kZipEncryptedFlag) ||
+      (entry.method != kZipStored && entry.method != kZipDeflated)) {
+    out->clear();
+    return {InflateStatus::kDataError, 0};
+  }
+
+  out->resize(entry.uncompressed_size);
+  /* the decoder does pointer arithmetic on out even for empty entries */
+  unsigned char empty;
+  InflateResult result = this->Extract(
+      entry, out->empty() ? &empty : out->data(), out->size(), decompressor);
+  if (!result.Ok()) out->clear();
+  return result;
+}
+
+/**
+ * Decompress many entries across a pool of threads, see ParallelForEach()
+ *
+ * @param entries entries of this archive
+ * @param outs receives the decompressed entries, in the same order
+ * @param threads number of threads; 0 for one per hardware thread
+ *
+ * @return status and number of bytes decompressed of each entry
+ */
+std::vector<InflateResult> ZipReader::ExtractParallel(
+    const std::vector<const ZipEntry*>& entries,
+    std::vector<std::vector<unsigned char>>* outs,
+    unsigned int threads) const {
+  auto results = std::vector<InflateResult>(
+      entries.size(), InflateResult{InflateStatus::kDataError, 0});
+  outs->resize(entries.size());
+
+  ParallelForEach<Decompressor>(
+      entries.size(), threads, [&](size_t i, Decompressor* decompressor) {
+        results[i] = this->Extract(*entries[i], &(*outs)[i], decompressor);
+      });
+
+  return results;
+}
+
+#endif /* !_ZIP_READER_H */
@@ -1,4 +1,5 @@
 #include <mutex>
+#include <future>
 #include <memory>
 #include <string>
 #include <fstream>
@@ -7,6 +8,9 @@
 #include <unordered_set>
 
 #include "utils/string.h"
+#include "utils/notices_parser.h"
+#include "utils/packages_cache.h"
+#include "utils/pattern_matcher.h"
 #include "inflatecpp/decompressor.h"
 
 #if defined(_WIN32)
@@ -19,41 +23,81 @@ class MediaKit {
  public:
   static MediaKit& GetInstance();
 
+  void FindPackagesAsync();
   void FindPackages();
 
  private:
-  std::mutex mutex_;
-  bool find_packages_success_ = false;
+  bool CheckPackages();
+#if defined(_WIN32) || defined(__linux__)
+  int ReadNotices(const std::string&, const std::string&,
+                  const PackagesCache&, PackagesVerdict*);
+#endif
+
+  std::once_flag find_packages_once_;
+  std::once_flag exit_once_;
+  /* whether the packages are compatible, once checked */
+  std::shared_future<bool> find_packages_result_;
 };
 
 MediaKit& MediaKit::GetInstance() {
-  static MediaKit instance;
-  return instance;
+  /* never destroyed: the check may still run, or be waited on, at exit */
+  static auto instance = new MediaKit();
+  return *instance;
 }
 
-void MediaKit::FindPackages() {
-  mutex_.lock();
+/**
+ * Start checking the packages of the app on a background thread, the first
+ * time only, and return at once
+ */
+void MediaKit::FindPackagesAsync() {
+  std::call_once(find_packages_once_, [this]() {
+    find_packages_result_ =
+        std::async(std::launch::async, &MediaKit::CheckPackages, this).share();
+  });
+}
 
-  if (find_packages_success_) {
+/**
+ * Wait for the packages of the app to be checked, starting the check if
+ * needed, and exit if some of them are outdated or incompatible
+ */
+void MediaKit::FindPackages() {
+  FindPackagesAsync();
+  if (find_packages_result_.get()) {
     return;
   }
-  find_packages_success_ = true;
 
+  std::call_once(exit_once_, []() {
+    std::cout << "GitHub  : https://github.com/media-kit/media-kit\n"
+              << "pub.dev : https://pub.dev/packages/media_kit\n"
+              << "Exiting...\n"
+              << std::endl;
+    ::exit(1);
+  });
+}
+
+/**
+ * Find the outdated and incompatible packages of the app in its NOTICES
+ * asset, and report them
+ *
+ * @return false if there are any; true otherwise, or if the asset cannot be
+ * read
+ */
+bool MediaKit::CheckPackages() {
   auto asset = std::string{};
   auto executable = std::string{};
 
 #if defined(_WIN32)
   auto result = std::make_unique<wchar_t[]>(4096);
   if (!SUCCEEDED(::GetModuleFileName(NULL, result.get(), 4096))) {
-    return; /* FAIL */
+    return true; /* FAIL */
   }
   auto data = String::ToString(result.get());
   if (data.empty()) {
-    return; /* FAIL */
+    return true; /* FAIL */
   }
   auto components = String::Split(data, "\\");
   if (components.empty()) {
-    return; /* FAIL */
+    return true; /* FAIL */
   }
   // ----------
   // asset
@@ -70,15 +114,15 @@ void MediaKit::FindPackages() {
   uint8_t dest[4096];
   memset(dest, 0, sizeof(dest));
   if (readlink("/proc/self/exe", reinterpret_cast<char*>(dest), 4096) == -1) {
-    return; /* FAIL */
+    return true; /* FAIL */
   }
   auto data = std::string(reinterpret_cast<char*>(dest));
   if (data.empty()) {
-    return; /* FAIL */
+    return true; /* FAIL */
   }
   auto components = String::Split(data, "/");
   if (components.empty()) {
-    return; /* FAIL */
+    return true; /* FAIL */
   }
   // ----------
   // asset
@@ -94,122 +138,145 @@ void MediaKit::FindPackages() {
 #endif
 
   if (asset.empty()) {
-    return; /* FAIL */
+    return true; /* FAIL */
   }
   if (executable.empty()) {
-    return; /* FAIL */
+    return true; /* FAIL */
   }
 
 #if defined(_WIN32) || defined(__linux__)
+  // ----------
+  // verdict, from the cache if the asset is unchanged
+  // ----------
+  auto verdict = PackagesVerdict{};
+  auto cache = PackagesCache{};
+  if (cache.Open(asset, executable) != 0 || cache.Load(&verdict) != 0) {
+    if (ReadNotices(asset, executable, cache, &verdict) != 0) {
+      return true; /* FAIL */
+    }
+  }
+
+  if (!verdict.unsupported.empty()) {
+    std::cout << std::string(80, '-') << "\n"
+              << "media_kit\n"
+              << "  Some packages are outdated.\n"
+              << "  Update all media_kit packages to use following package(s):\n";
+    for (const auto& name : verdict.unsupported) {
+      std::cout << "    * " << name << "\n";
+    }
+    std::cout << std::string(80, '-') << "\n";
+    std::cout << std::endl;
+  }
+  if (!verdict.incompatible.empty()) {
+    std::cout << std::string(80, '-') << "\n"
+              << "media_kit\n"
+              << "  Following packages(s) are incompatible:\n";
+    for (const auto& name : verdict.incompatible) {
+      std::cout << "    * " << name << "\n";
+    }
+    std::cout << std::string(80, '-') << "\n";
+    std::cout << std::endl;
+  }
+
+  return verdict.unsupported.empty() && verdict.incompatible.empty();
+#else
+  return true;
+#endif
+}
+
+#if defined(_WIN32) || defined(__linux__)
+/**
+ * Read the NOTICES asset, find the outdated and incompatible packages in it,
+ * and cache the verdict
+ *
+ * @param asset path to the NOTICES asset
+ * @param executable name of the running executable
+ * @param cache cache entry of the asset
+ * @param verdict verdict, filled on success
+ *
+ * @return 0 for success, -1 for error
+ */
+int MediaKit::ReadNotices(const std::string& asset,
+                          const std::string& executable,
+                          const PackagesCache& cache,
+                          PackagesVerdict* verdict) {
   auto decompressor = Decompressor{};
   auto file =
       std::fstream{asset, std::ios::in | std::ios::app | std::ios::binary};
 
   if (!file.is_open()) {
-    return; /* FAIL */
+    return -1; /* FAIL */
   }
 
-  constexpr auto max = 10 * 1024 * 1024;
-
-  auto in = std::make_unique<uint8_t[]>(max);
-  auto out = std::make_unique<uint8_t[]>(max);
-
   file.seekg(0, std::ios::end);
-  auto size = file.tellg();
+  auto size = static_cast<size_t>(file.tellg());
   file.seekg(0, std::ios::beg);
+
+  auto in = std::make_unique<uint8_t[]>(size);
   file.read(reinterpret_cast<char*>(in.get()), size);
   file.close();
 
-  auto len = decompressor.Feed(in.get(), size, out.get(), max, true);
+  // ----------
+  // NOTICES, parsed as it is decompressed
+  // ----------
+  auto parser = NoticesParser{};
+  auto result = decompressor.FeedStreaming(in.get(), size, &parser, true);
 
-  if (len == -1) {
-    return; /* FAIL */
+  if (!result.Ok() || result.size > NoticesParser::kMaxSize) {
+    return -1; /* FAIL */
   }
+  parser.Finish();
 
-  auto content = std::string{out.get(), out.get() + len};
-  auto elements = String::Split(content, std::string(80, '-'));
-
-  auto names = std::unordered_set<std::string>{};
-
-  for (const auto& element : elements) {
-    auto found = false;
-    auto current = std::unordered_set<std::string>{};
-    auto lines = String::Split(element, "\n");
-    for (const auto& line : lines) {
-      auto value = String::Trim(line);
-      if (!value.empty()) {
-        current.emplace(String::Trim(value));
-        found = true;
-      }
-      if (found && value.empty()) {
-        break;
-      }
-    }
-    for (const auto& e : current) {
-      names.emplace(e);
-    }
+  auto names = std::unordered_set<std::string_view>{};
+  for (const auto& name : parser.GetNames()) {
+    names.emplace(name);
   }
 
-  auto supported = std::unordered_set<std::string>{
-      "media_kit",
-      "media_kit_video",
-      "media_kit_native_event_loop",
-  };
+  // ----------
+  // package rules, matched in one pass over every name
+  // ----------
+  auto rules = PatternMatcher{};
+  auto media_kit = 1ULL << rules.Add("media_kit");
+  auto media_kit_libs =
+      1ULL << rules.Add("media_kit_libs", PatternKind::kPrefix);
+  auto video = 1ULL << rules.Add("video");
+  auto player = 1ULL << rules.Add("player");
+  auto video_player = 1ULL << rules.Add("video_player");
+  auto dash = 1ULL << rules.Add("-");
+  auto supported = 0ULL;
+  for (auto package : {
+           "media_kit",
+           "media_kit_video",
+           "media_kit_native_event_loop",
+       }) {
+    supported |= 1ULL << rules.Add(package, PatternKind::kExact);
+  }
+  rules.Build();
 
   auto unsupported = std::unordered_set<std::string>();
   auto incompatible = std::unordered_set<std::string>();
 
-  for (auto& name : names) {
+  for (const auto& name : names) {
     if (!String::Contains(executable, name)) {
-      if (String::Contains(name, "media_kit")) {
-        if (!String::StartsWith(name, "media_kit_libs") &&
-            !(std::find(supported.begin(), supported.end(), name) != supported.end())) {
+      auto labels = rules.Match(name);
+      if (labels & media_kit) {
+        if (!(labels & (media_kit_libs | supported))) {
           unsupported.emplace(name);
         }
-      } else if (String::Contains(name, "video") &&
-                 String::Contains(name, "player")) {
-        if (!String::Contains(name, "video_player") &&
-            !String::Contains(name, "-")) {
+      } else if ((labels & video) && (labels & player)) {
+        if (!(labels & (video_player | dash))) {
           incompatible.emplace(name);
         }
       }
     }
   }
 
-  if (!unsupported.empty() || !incompatible.empty()) {
-    find_packages_success_ = false;
-  }
+  verdict->unsupported.assign(unsupported.begin(), unsupported.end());
+  verdict->incompatible.assign(incompatible.begin(), incompatible.end());
+  std::sort(verdict->unsupported.begin(), verdict->unsupported.end());
+  std::sort(verdict->incompatible.begin(), verdict->incompatible.end());
 
-  if (!unsupported.empty()) {
-    std::cout << std::string(80, '-') << "\n"
-              << "media_kit\n"
-              << "  Some packages are outdated.\n"
-              << "  Update all media_kit packages to use following package(s):\n";
-    for (const auto& name : unsupported) {
-      std::cout << "    * " << name << "\n";
-    }
-    std::cout << std::string(80, '-') << "\n";
-    std::cout << std::endl;
-  }
-  if (!incompatible.empty()) {
-    std::cout << std::string(80, '-') << "\n"
-              << "media_kit\n"
-              << "  Following packages(s) are incompatible:\n";
-    for (const auto& name : incompatible) {
-      std::cout << "    * " << name << "\n";
-    }
-    std::cout << std::string(80, '-') << "\n";
-    std::cout << std::endl;
-  }
-
-  mutex_.unlock();
-
-  if (!find_packages_success_) {
-    std::cout << "GitHub  : https://github.com/media-kit/media-kit\n"
-              << "pub.dev : https://pub.dev/packages/media_kit\n"
-              << "Exiting...\n"
-              << std::endl;
-    ::exit(1);
-  }
-#endif
+  cache.Store(*verdict, in.get(), size);
+  return 0;
 }
+#endif
@@ -0,0 +1,187 @@
+#ifndef _NOTICES_PARSER_H
+#define _NOTICES_PARSER_H
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "inflatecpp/decompressor.h"
+#include "utils/string.h"
+
+/**
+ * Single-pass parser of Flutter's NOTICES file, fed with the decompressed
+ * data as the decoder produces it. The file is a series of entries split by
+ * 80-dash separators; every entry starts with the names of its packages,
+ * one per line, up to the first blank line, and goes on with license text.
+ *
+ * Only the header lines of an entry are buffered. License text is skipped
+ * 16 bytes at a time, looking for dashes only, until the next separator.
+ * Names are kept back to back in a single buffer, and handed out as views
+ * into it.
+ *
+ * Decoding stops at the first block boundary past kMaxSize bytes, so that a
+ * corrupt asset cannot keep the decoder busy; a result over that size is a
+ * failure.
+ */
+class NoticesParser : public InflateStreamObserver {
+ public:
+  static constexpr size_t kSeparatorSize = 80;
+  static constexpr size_t kMaxSize = 10 * 1024 * 1024;
+
+  void OnData(const unsigned char*, size_t) override;
+  bool OnBlockBoundary(const InflateBlockBoundary&) override;
+  void Finish();
+
+  /** Package names, in order and with duplicates; valid as long as the
+   * parser is */
+  const std::vector<std::string_view>& GetNames() const { return names_; }
+
+ private:
+  enum class State { kHeader, kText };
+
+  State state_ = State::kHeader;
+  /* a name was seen in the current entry */
+  bool found_ = false;
+  /* dashes since the last separator or other byte */
+  size_t dash_run_ = 0;
+  /* current header line, unprocessed */
+  std::string line_;
+  /* names, back to back, and their offsets and sizes in there */
+  std::string buffer_;
+  std::vector<std::pair<size_t, size_t>> spans_;
+  std::vector<std::string_view> names_;
+
+  size_t SkipText(const unsigned char*, size_t);
+  void EndLine();
+  void Separator();
+};
+
+/**
+ * Skip license text up to the end of the next separator
+ *
+ * @param data pointer to start of the data
+ * @param size size of the data, in bytes
+ *
+ * @return number of bytes consumed: past the separator if one ends in the
+ * data, otherwise all of them
+ */
+size_t NoticesParser::SkipText(const unsigned char* data, size_t size) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i dash = _mm_set1_epi8('-');
+  while (i + 16 <= size) {
+    unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), dash)));
+    if (mask == 0xffff) {
+      if (dash_run_ + 16 >= kSeparatorSize) break;
+      dash_run_ += 16;
+    } else {
+      /* dashes continuing the current run, then those ending the block */
+      unsigned int leading = __builtin_ctz(~mask);
+      if (dash_run_ + leading >= kSeparatorSize) break;
+      dash_run_ = __builtin_clz(~(mask << 16));
+    }
+    i += 16;
+  }
+#endif
+
+  for (; i < size; i++) {
+    if (data[i] != '-') {
+      dash_run_ = 0;
+      continue;
+    }
+    if (++dash_run_ == kSeparatorSize) {
+      Separator();
+      return i + 1;
+    }
+  }
+  return size;
+}
+
+/** Take the current header line, trimmed */
+void NoticesParser::EndLine() {
+  auto name = String::TrimView(line_);
+  if (name.empty()) {
+    /* a blank line ends the names */
+    if (found_) {
+      state_ = State::kText;
+    }
+  } else {
+    spans_.emplace_back(buffer_.size(), name.size());
+    buffer_.append(name);
+    found_ = true;
+  }
+  line_.clear();
+}
+
+/** End the current entry at a separator, and start the next one */
+void NoticesParser::Separator() {
+  if (state_ == State::kHeader) {
+    /* the separator ends the line too; its dashes are not part of it */
+    line_.resize(line_.size() - kSeparatorSize);
+    EndLine();
+  }
+  state_ = State::kHeader;
+  found_ = false;
+  dash_run_ = 0;
+  line_.clear();
+}
+
+/**
+ * Consume decompressed data
+ *
+ * @param data pointer to start of the data
+ * @param size size of the data, in bytes
+ */
+void NoticesParser::OnData(const unsigned char* data, size_t size) {
+  size_t i = 0;
+  while (i < size) {
+    if (state_ == State::kText) {
+      i += SkipText(data + i, size - i);
+      continue;
+    }
+
+    auto c = data[i++];
+    if (c == '\n') {
+      dash_run_ = 0;
+      EndLine();
+      continue;
+    }
+    line_.push_back(static_cast<char>(c));
+    if (c != '-') {
+      dash_run_ = 0;
+    } else if (++dash_run_ == kSeparatorSize) {
+      Separator();
+    }
+  }
+}
+
+/**
+ * Stop decoding once the NOTICES file is over kMaxSize bytes
+ *
+ * @param boundary block boundary
+ *
+ * @return false to stop decoding
+ */
+bool NoticesParser::OnBlockBoundary(const InflateBlockBoundary& boundary) {
+  return boundary.out_offset <= kMaxSize;
+}
+
+/** Take the last line, once all data is consumed, and hand out the names */
+void NoticesParser::Finish() {
+  if (state_ == State::kHeader) {
+    EndLine();
+  }
+  names_.clear();
+  for (const auto& span : spans_) {
+    names_.emplace_back(buffer_.data() + span.first, span.second);
+  }
+}
+
+#endif /* !_NOTICES_PARSER_H */
@@ -0,0 +1,287 @@
+#ifndef _PACKAGES_CACHE_H
+#define _PACKAGES_CACHE_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "inflatecpp/decompressor.h"
+
+/** Verdict of MediaKit::FindPackages() on a NOTICES file */
+struct PackagesVerdict {
+  /* outdated media_kit packages */
+  std::vector<std::string> unsupported;
+  /* video player packages that conflict with media_kit */
+  std::vector<std::string> incompatible;
+};
+
+/**
+ * Cache of the FindPackages() verdicts, one small text file per NOTICES
+ * asset in a per-user cache directory. An entry is keyed on the asset's
+ * path, size and modification time, and on the name of the executable the
+ * verdict depends on, so a warm start only stats the asset and reads the
+ * entry.
+ *
+ * As with git's racily clean index entries, an asset modified no earlier
+ * than its entry was written could have changed again within the timestamp
+ * granularity, keeping its size and time: its content is then checked
+ * against the Adler-32 stored in the entry.
+ */
+class PackagesCache {
+ public:
+  PackagesCache(){};
+
+  int Open(const std::string&, const std::string&);
+  int Load(PackagesVerdict*) const;
+  int Store(const PackagesVerdict&, const unsigned char*, size_t) const;
+
+ private:
+  /* asset and executable, as given to Open() */
+  std::string asset_name_;
+  std::string executable_;
+  /* asset, as of Open() */
+  std::filesystem::path asset_;
+  unsigned long long size_ = 0;
+  std::filesystem::file_time_type mtime_;
+  /* cache entry; empty if caching is not possible */
+  std::filesystem::path file_;
+};
+
+/** First line of a cache entry, changed with its format */
+constexpr const char* kPackagesCacheMagic = "media_kit-packages 1";
+
+/**
+ * Get the per-user cache directory of media_kit: under %LOCALAPPDATA% on
+ * Windows, $XDG_CACHE_HOME or ~/.cache elsewhere
+ *
+ * @return directory, which may not exist yet, or an empty path if there is
+ * none
+ */
+std::filesystem::path GetPackagesCacheDirectory() {
+#if defined(_WIN32)
+  auto local = _wgetenv(L"LOCALAPPDATA");
+  if (local && *local) {
+    return std::filesystem::path{local} / "media_kit";
+  }
+#else
+  auto cache = std::getenv("XDG_CACHE_HOME");
+  if (cache && *cache == '/') {
+    return std::filesystem::path{cache} / "media_kit";
+  }
+  auto home = std::getenv("HOME");
+  if (home && *home == '/') {
+    return std::filesystem::path{home} / ".cache" / "media_kit";
+  }
+#endif
+  return std::filesystem::path{};
+}
+
+/**
+ * Adler-32 of a buffer, of any size
+ *
+ * @param data pointer to start of the data
+ * @param size size of the data, in bytes
+ *
+ * @return checksum
+ */
+unsigned int PackagesCacheChecksum(const unsigned char* data, size_t size) {
+  constexpr size_t kMaxBlock = 1U << 30;
+  unsigned int checksum = 1;
+  while (size) {
+    auto block = size < kMaxBlock ? size : kMaxBlock;
+    checksum = GetInflateKernels().adler32(checksum, data,
+                                           static_cast<unsigned int>(block));
+    data += block;
+    size -= block;
+  }
+  return checksum;
+}
+
+/**
+ * Look up the cache entry of an asset, and stat the asset
+ *
+ * @param asset path to the NOTICES asset, in UTF-8
+ * @param executable name of the running executable
+ *
+ * @return 0 for success, -1 if the asset or the cache directory cannot be
+ * found; Load() and Store() then fail
+ */
+int PackagesCache::Open(const std::string& asset,
+                        const std::string& executable) {
+  file_.clear();
+  if (asset.find('\n') != std::string::npos ||
+      executable.find('\n') != std::string::npos) {
+    return -1;
+  }
+
+  auto directory = GetPackagesCacheDirectory();
+  if (directory.empty()) {
+    return -1;
+  }
+
+  auto error = std::error_code{};
+  asset_ = std::filesystem::u8path(asset);
+  size_ = std::filesystem::file_size(asset_, error);
+  if (error) {
+    return -1;
+  }
+  mtime_ = std::filesystem::last_write_time(asset_, error);
+  if (error) {
+    return -1;
+  }
+  asset_name_ = asset;
+  executable_ = executable;
+
+  /* FNV-1a of the key, for the entry's name; the key itself is stored in
+   * the entry, so collisions are misses */
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+  for (auto c : asset + '\0' + executable) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "packages-%016llx", hash);
+  file_ = directory / name;
+  return 0;
+}
+
+/**
+ * Read the verdict for the asset, if its entry is still valid
+ *
+ * @param verdict verdict, filled on success
+ *
+ * @return 0 for a hit, -1 for a miss
+ */
+int PackagesCache::Load(PackagesVerdict* verdict) const {
+  if (file_.empty()) {
+    return -1;
+  }
+
+  auto error = std::error_code{};
+  auto written = std::filesystem::last_write_time(file_, error);
+  if (error) {
+    return -1;
+  }
+  auto file = std::ifstream{file_, std::ios::in | std::ios::binary};
+  if (!file.is_open()) {
+    return -1;
+  }
+
+  auto magic = std::string{};
+  auto asset = std::string{};
+  auto executable = std::string{};
+  if (!std::getline(file, magic) || magic != kPackagesCacheMagic ||
+      !std::getline(file, asset) || asset != asset_name_ ||
+      !std::getline(file, executable) || executable != executable_) {
+    return -1;
+  }
+
+  unsigned long long size = 0;
+  long long mtime = 0;
+  unsigned int checksum = 0;
+  size_t unsupported = 0, incompatible = 0;
+  if (!(file >> size >> mtime >> checksum >> unsupported >> incompatible) ||
+      size != size_ || mtime != mtime_.time_since_epoch().count()) {
+    return -1;
+  }
+  file.ignore(1);
+
+  if (mtime_ >= written) {
+    /* racily clean: the asset may have changed since */
+    auto in = std::ifstream{asset_, std::ios::in | std::ios::binary};
+    auto data = std::make_unique<unsigned char[]>(size_);
+    if (!in.read(reinterpret_cast<char*>(data.get()), size_) ||
+        PackagesCacheChecksum(data.get(), size_) != checksum) {
+      return -1;
+    }
+  }
+
+  auto result = PackagesVerdict{};
+  auto name = std::string{};
+  while (result.unsupported.size() < unsupported) {
+    if (!std::getline(file, name)) {
+      return -1;
+    }
+    result.unsupported.push_back(name);
+  }
+  while (result.incompatible.size() < incompatible) {
+    if (!std::getline(file, name)) {
+      return -1;
+    }
+    result.incompatible.push_back(name);
+  }
+
+  *verdict = std::move(result);
+  return 0;
+}
+
+/**
+ * Write the entry of the asset, replacing any previous one at once
+ *
+ * @param verdict verdict for the asset
+ * @param data pointer to start of the asset's content, as read after Open()
+ * @param size size of the content, in bytes
+ *
+ * @return 0 for success, -1 for error
+ */
+int PackagesCache::Store(const PackagesVerdict& verdict,
+                         const unsigned char* data, size_t size) const {
+  if (file_.empty() || size != size_) {
+    return -1;
+  }
+
+  auto error = std::error_code{};
+  std::filesystem::create_directories(file_.parent_path(), error);
+  if (error) {
+    return -1;
+  }
+
+#if defined(_WIN32)
+  auto pid = _getpid();
+#else
+  auto pid = getpid();
+#endif
+  auto temporary = file_;
+  temporary += ".tmp" + std::to_string(pid);
+
+  auto file = std::ofstream{
+      temporary, std::ios::out | std::ios::binary | std::ios::trunc};
+  file << kPackagesCacheMagic << "\n"
+       << asset_name_ << "\n"
+       << executable_ << "\n"
+       << size_ << " " << mtime_.time_since_epoch().count() << " "
+       << PackagesCacheChecksum(data, size) << " "
+       << verdict.unsupported.size() << " " << verdict.incompatible.size()
+       << "\n";
+  for (const auto& name : verdict.unsupported) {
+    file << name << "\n";
+  }
+  for (const auto& name : verdict.incompatible) {
+    file << name << "\n";
+  }
+  file.close();
+
+  if (!file) {
+    std::filesystem::remove(temporary, error);
+    return -1;
+  }
+  std::filesystem::rename(temporary, file_, error);
+  if (error) {
+    std::filesystem::remove(temporary, error);
+    return -1;
+  }
+  return 0;
+}
+
+#endif /* !_PACKAGES_CACHE_H */
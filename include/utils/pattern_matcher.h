@@ -0,0 +1,175 @@
+#ifndef _PATTERN_MATCHER_H
+#define _PATTERN_MATCHER_H
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/** Where a pattern has to be in a string to match it */
+enum class PatternKind {
+  kContains, /* anywhere */
+  kPrefix,   /* at the start */
+  kExact,    /* the whole string */
+};
+
+/**
+ * Multi-pattern matcher, after Aho and Corasick. The patterns are compiled
+ * into a DFA over byte classes, bytes that are in no pattern sharing one
+ * class, and Match() labels a string with all the patterns it matches in a
+ * single pass over its bytes, whatever their number.
+ *
+ * Prefix and exact patterns are found through the depth of the states: as
+ * long as it equals the number of bytes read, the state is the trie node of
+ * the whole string read so far.
+ */
+class PatternMatcher {
+ public:
+  static constexpr int kMaxPatterns = 64;
+
+  PatternMatcher(){};
+
+  int Add(std::string_view, PatternKind = PatternKind::kContains);
+  void Build();
+  unsigned long long Match(std::string_view) const;
+
+ private:
+  struct State {
+    /* patterns matched when the state is reached, by kind */
+    unsigned long long contains;
+    unsigned long long prefix;
+    unsigned long long exact;
+    /* length of the longest pattern prefix the state stands for */
+    size_t depth;
+  };
+
+  std::vector<std::pair<std::string, PatternKind>> patterns_;
+  /* class of every byte; 0 for those in no pattern */
+  unsigned short classes_[256] = {};
+  size_t class_count_ = 1;
+  /* DFA: next state, by state and byte class */
+  std::vector<unsigned int> next_;
+  std::vector<State> states_;
+};
+
+/**
+ * Add a pattern; Build() must be called before matching again
+ *
+ * @param pattern pattern
+ * @param kind where the pattern has to be in a string to match it
+ *
+ * @return index of the pattern, whose bit is set in the results of Match(),
+ * or -1 if there are kMaxPatterns already
+ */
+int PatternMatcher::Add(std::string_view pattern, PatternKind kind) {
+  if (patterns_.size() >= static_cast<size_t>(kMaxPatterns)) {
+    return -1;
+  }
+  patterns_.emplace_back(std::string{pattern}, kind);
+  return static_cast<int>(patterns_.size() - 1);
+}
+
+/** Compile the patterns added so far */
+void PatternMatcher::Build() {
+  std::fill(std::begin(classes_), std::end(classes_), 0);
+  class_count_ = 1;
+  for (const auto& pattern : patterns_) {
+    for (auto c : pattern.first) {
+      auto& byte_class = classes_[static_cast<unsigned char>(c)];
+      if (!byte_class) {
+        byte_class = static_cast<unsigned short>(class_count_++);
+      }
+    }
+  }
+
+  /* trie; missing edges are 0, the root */
+  next_.assign(class_count_, 0);
+  states_.assign(1, State{0, 0, 0, 0});
+  for (size_t i = 0; i < patterns_.size(); i++) {
+    unsigned int state = 0;
+    for (auto c : patterns_[i].first) {
+      auto edge =
+          state * class_count_ + classes_[static_cast<unsigned char>(c)];
+      if (!next_[edge]) {
+        next_[edge] = static_cast<unsigned int>(states_.size());
+        next_.resize(next_.size() + class_count_, 0);
+        states_.push_back(State{0, 0, 0, states_[state].depth + 1});
+      }
+      state = next_[edge];
+    }
+
+    auto bit = 1ULL << i;
+    switch (patterns_[i].second) {
+      case PatternKind::kContains:
+        states_[state].contains |= bit;
+        break;
+      case PatternKind::kPrefix:
+        states_[state].prefix |= bit;
+        break;
+      case PatternKind::kExact:
+        states_[state].exact |= bit;
+        break;
+    }
+  }
+
+  /* failure links, breadth first, turned into DFA edges on the way; a state
+   * also matches the patterns contained in its failure state */
+  auto fail = std::vector<unsigned int>(states_.size(), 0);
+  auto queue = std::vector<unsigned int>{};
+  for (size_t c = 0; c < class_count_; c++) {
+    if (next_[c]) {
+      queue.push_back(next_[c]);
+    }
+  }
+  for (size_t head = 0; head < queue.size(); head++) {
+    auto state = queue[head];
+    states_[state].contains |= states_[fail[state]].contains;
+    for (size_t c = 0; c < class_count_; c++) {
+      auto& next = next_[state * class_count_ + c];
+      auto fallback = next_[fail[state] * class_count_ + c];
+      if (next) {
+        fail[next] = fallback;
+        queue.push_back(next);
+      } else {
+        next = fallback;
+      }
+    }
+  }
+}
+
+/**
+ * Find the patterns a string matches
+ *
+ * @param s string
+ *
+ * @return bit mask of the indices of the patterns matched
+ */
+unsigned long long PatternMatcher::Match(std::string_view s) const {
+  if (states_.empty()) {
+    return 0;
+  }
+
+  unsigned int state = 0;
+  auto result = states_[0].contains | states_[0].prefix;
+  auto anchored = true;
+  for (size_t i = 0; i < s.size(); i++) {
+    state = next_[state * class_count_ +
+                  classes_[static_cast<unsigned char>(s[i])]];
+    result |= states_[state].contains;
+    if (anchored) {
+      if (states_[state].depth == i + 1) {
+        result |= states_[state].prefix;
+      } else {
+        anchored = false;
+      }
+    }
+  }
+  if (anchored) {
+    result |= states_[state].exact;
+  }
+  return result;
+}
+
+#endif /* !_PATTERN_MATCHER_H */
@@ -1,42 +1,176 @@
+#ifndef _UTILS_STRING_H
+#define _UTILS_STRING_H
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif /* defined(__SSE2__) */
+
+#include "inflatecpp/cpu_features.h"
+
 #if defined(_WIN32)
 #include <Windows.h>
 #endif
 
 class String {
  public:
+  /** Lazy split of a string, see String::SplitView() */
+  class SplitRange {
+   public:
+    class Iterator {
+     public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = std::string_view;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const std::string_view*;
+      using reference = const std::string_view&;
+
+      Iterator(){};
+      Iterator(std::string_view s, std::string_view delimiter)
+          : s_(s), delimiter_(delimiter), done_(false) {
+        Next(0);
+      };
+
+      reference operator*() const { return token_; };
+      pointer operator->() const { return &token_; };
+
+      Iterator& operator++() {
+        if (end_ == std::string_view::npos) {
+          done_ = true;
+        } else {
+          Next(end_ + delimiter_.size());
+        }
+        return *this;
+      };
+      Iterator operator++(int) {
+        auto previous = *this;
+        ++*this;
+        return previous;
+      };
+
+      bool operator==(const Iterator& other) const {
+        return done_ == other.done_ && (done_ || start_ == other.start_);
+      };
+      bool operator!=(const Iterator& other) const {
+        return !(*this == other);
+      };
+
+     private:
+      std::string_view s_;
+      std::string_view delimiter_;
+      std::string_view token_;
+      /* current token, from start_ up to end_, or npos for the last one */
+      size_t start_ = 0;
+      size_t end_ = std::string_view::npos;
+      bool done_ = true;
+
+      void Next(size_t start) {
+        start_ = start;
+        end_ = delimiter_.empty() ? std::string_view::npos
+                                  : String::Find(s_, delimiter_, start);
+        token_ = s_.substr(start, end_ == std::string_view::npos
+                                      ? std::string_view::npos
+                                      : end_ - start);
+      };
+    };
+
+    SplitRange(std::string_view s, std::string_view delimiter)
+        : s_(s), delimiter_(delimiter){};
+
+    Iterator begin() const { return Iterator{s_, delimiter_}; };
+    Iterator end() const { return Iterator{}; };
+
+   private:
+    std::string_view s_;
+    std::string_view delimiter_;
+  };
+
+  /**
+   * Find a substring, comparing the first and last bytes of the key at 16 or
+   * 32 positions at a time with SSE2, AVX2 or NEON, and the rest of it only
+   * where both match
+   *
+   * @param s string to search
+   * @param key substring to look for
+   * @param start position to start at
+   *
+   * @return position of the first occurrence, or npos
+   */
+  static size_t Find(std::string_view s, std::string_view key,
+                     size_t start = 0) {
+    if (start > s.size() || key.size() > s.size() - start) {
+      return std::string_view::npos;
+    }
+    if (key.empty()) {
+      return start;
+    }
+    if (key.size() == 1) {
+      auto found = std::memchr(s.data() + start, key[0], s.size() - start);
+      return found ? static_cast<const char*>(found) - s.data()
+                   : std::string_view::npos;
+    }
+#if defined(INFLATECPP_X86_DISPATCH)
+    static const bool avx2 = DetectCpuFeatures() & kCpuAvx2;
+    if (avx2) {
+      start = FindAvx2(s, key, start);
+    } else {
+      start = FindVector(s, key, start);
+    }
+#else
+    start = FindVector(s, key, start);
+#endif /* defined(INFLATECPP_X86_DISPATCH) */
+    return s.find(key, start);
+  }
+
+  /**
+   * Split a string, without copying it
+   *
+   * @param s string to split; must outlive the range
+   * @param delimiter delimiter; must outlive the range
+   *
+   * @return range of views into s, produced as it is iterated; an empty
+   * delimiter yields s whole
+   */
+  static SplitRange SplitView(std::string_view s, std::string_view delimiter) {
+    return SplitRange{s, delimiter};
+  }
+
   static std::vector<std::string> Split(std::string s, std::string delimiter) {
-    size_t start = 0, end, size = delimiter.length();
-    auto token = std::string{};
     auto result = std::vector<std::string>{};
-    while ((end = s.find(delimiter, start)) != std::string::npos) {
-      token = s.substr(start, end - start);
-      start = end + size;
-      result.push_back(token);
+    for (const auto& token : SplitView(s, delimiter)) {
+      result.emplace_back(token);
     }
-    result.push_back(s.substr(start));
     return result;
   }
 
-  static bool Contains(std::string s, std::string key) {
-    return s.find(key) != std::string::npos;
+  static bool Contains(std::string_view s, std::string_view key) {
+    return Find(s, key) != std::string_view::npos;
   }
 
-  static bool StartsWith(std::string s, std::string key) {
-    return s.rfind(key, 0) == 0;
+  static bool StartsWith(std::string_view s, std::string_view key) {
+    return s.size() >= key.size() && s.compare(0, key.size(), key) == 0;
   }
 
-  static std::string Trim(std::string s) {
-    auto result = std::string{};
+  /** Trim whitespace, without copying; the view points into s */
+  static std::string_view TrimView(std::string_view s) {
     auto start = s.find_first_not_of(" \t\r\n");
-    auto end = s.find_last_not_of(" \t\r\n");
-    if (start == std::string::npos || end == std::string::npos) {
-      return result;
+    if (start == std::string_view::npos) {
+      return std::string_view{};
     }
-    result = s.substr(start, end - start + 1);
-    return result;
+    auto end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+  }
+
+  static std::string Trim(std::string s) {
+    return std::string{TrimView(s)};
   }
 
 #if defined(_WIN32)
@@ -61,4 +195,91 @@ class String {
     return result;
   }
 #endif
+
+ private:
+  /**
+   * Skip the positions of s that cannot start key, a vector at a time;
+   * key is at least 2 bytes long
+   *
+   * @return position of the first match, or the position to go on from
+   * with a scalar search
+   */
+  static size_t FindVector(std::string_view s, std::string_view key,
+                           size_t start) {
+    auto data = s.data();
+    auto last = key.size() - 1;
+    auto end = s.size() - last;
+#if defined(__SSE2__)
+    const __m128i first_byte = _mm_set1_epi8(key[0]);
+    const __m128i last_byte = _mm_set1_epi8(key[last]);
+    for (; start + 16 <= end; start += 16) {
+      unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(
+          _mm_and_si128(
+              _mm_cmpeq_epi8(
+                  _mm_loadu_si128((const __m128i*)(data + start)),
+                  first_byte),
+              _mm_cmpeq_epi8(
+                  _mm_loadu_si128((const __m128i*)(data + start + last)),
+                  last_byte))));
+      for (; mask; mask &= mask - 1) {
+        auto position = start + __builtin_ctz(mask);
+        if (std::memcmp(data + position + 1, key.data() + 1, last - 1) == 0) {
+          return position;
+        }
+      }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t first_byte = vdupq_n_u8(key[0]);
+    const uint8x16_t last_byte = vdupq_n_u8(key[last]);
+    for (; start + 16 <= end; start += 16) {
+      uint8x16_t equal = vandq_u8(
+          vceqq_u8(vld1q_u8((const uint8_t*)(data + start)), first_byte),
+          vceqq_u8(vld1q_u8((const uint8_t*)(data + start + last)),
+                   last_byte));
+      /* one nibble per byte */
+      unsigned long long mask = vget_lane_u64(
+          vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+      while (mask) {
+        auto nibble = __builtin_ctzll(mask) >> 2;
+        auto position = start + nibble;
+        if (std::memcmp(data + position + 1, key.data() + 1, last - 1) == 0) {
+          return position;
+        }
+        mask &= ~(0xfULL << (nibble << 2));
+      }
+    }
+#endif /* defined(__SSE2__) */
+    return start;
+  }
+
+#if defined(INFLATECPP_X86_DISPATCH)
+  /** FindVector() with 32-byte vectors */
+  __attribute__((target("avx2"))) static size_t FindAvx2(
+      std::string_view s, std::string_view key, size_t start) {
+    auto data = s.data();
+    auto last = key.size() - 1;
+    auto end = s.size() - last;
+    const __m256i first_byte = _mm256_set1_epi8(key[0]);
+    const __m256i last_byte = _mm256_set1_epi8(key[last]);
+    for (; start + 32 <= end; start += 32) {
+      unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(
+          _mm256_and_si256(
+              _mm256_cmpeq_epi8(
+                  _mm256_loadu_si256((const __m256i*)(data + start)),
+                  first_byte),
+              _mm256_cmpeq_epi8(
+                  _mm256_loadu_si256((const __m256i*)(data + start + last)),
+                  last_byte))));
+      for (; mask; mask &= mask - 1) {
+        auto position = start + __builtin_ctz(mask);
+        if (std::memcmp(data + position + 1, key.data() + 1, last - 1) == 0) {
+          return position;
+        }
+      }
+    }
+    return FindVector(s, key, start);
+  }
+#endif /* defined(INFLATECPP_X86_DISPATCH) */
 };
+
+#endif /* !_UTILS_STRING_H */